@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a set of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,6 +12,12 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * breadahead starts reading a block the caller expects to
+//     need soon; it does not wait and returns no buffer.
+// * To keep many writes in flight, call bwrite_async on each
+//     locked buffer, then bwait on each before brelse.
+// * Surround a batch of bwrite_async/breadahead calls with
+//     bplug/bunplug so the disk layer can merge adjacent blocks.
 
 
 #include "types.h"
@@ -22,17 +28,87 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
+
+// Buffers are replaced with the 2Q policy, so that one
+// large sequential read cannot flush the bitmap, inode and
+// directory blocks that nearly every system call uses.
+// A block read into the cache for the first time goes on the
+// A1in FIFO. Re-referencing it while it is there does not
+// promote it (a cat touches each block several times in a row).
+// When it falls off A1in its number is remembered in the A1out
+// ghost list; a miss on a block found in A1out means the block
+// is reused over a longer interval, so it goes on Am, an
+// ordinary LRU list. Buffers with refcnt > 0 -- in use, or
+// pinned by log_write() -- are never replaced.
+
+#define KIN     (NBUF/4)  // A1in's share of the cache
+#define NA1OUT  (NBUF/2)  // blocks remembered in A1out
+
+enum { A1IN, AM };
 
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // Linked lists of buffers, through prev/next.
+  // a1in.next is the newest block on A1in, a1in.prev the oldest.
+  // am.next is the most recently used block on Am, am.prev least.
+  struct buf a1in;
+  struct buf am;
+  int na1in;  // number of buffers on a1in
+
+  // A1out: FIFO ring of recently replaced A1in blocks.
+  struct {
+    uint dev;
+    uint blockno;
+    int used;
+  } a1out[NA1OUT];
+  int a1outnext;
+
+  // blocks below metaend hold log, inodes and bitmap.
+  uint metaend;
+
+  // counters reported by iostat(); updated atomically.
+  struct iostat stat;
 } bcache;
 
+#define bstatinc(x) __sync_fetch_and_add(&bcache.stat.x, 1)
+
+// Put b at the front of list head.
+// Caller must hold bcache.lock.
+static void
+bpush(struct buf *head, struct buf *b)
+{
+  b->next = head->next;
+  b->prev = head;
+  head->next->prev = b;
+  head->next = b;
+  b->queue = (head == &bcache.a1in) ? A1IN : AM;
+  if(b->queue == A1IN)
+    bcache.na1in++;
+}
+
+// Take b off whichever list it is on.
+// Caller must hold bcache.lock.
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  if(b->queue == A1IN)
+    bcache.na1in--;
+}
+
+// Move b to the most-recently-used end of Am.
+// Caller must hold bcache.lock.
+static void
+bmru(struct buf *b)
+{
+  bunlink(b);
+  bpush(&bcache.am, b);
+}
+
 void
 binit(void)
 {
@@ -40,16 +116,120 @@ binit(void)
 
   initlock(&bcache.lock, "bcache");
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Create linked lists of buffers; all start on Am.
+  bcache.a1in.prev = &bcache.a1in;
+  bcache.a1in.next = &bcache.a1in;
+  bcache.am.prev = &bcache.am;
+  bcache.am.next = &bcache.am;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bpush(&bcache.am, b);
+  }
+}
+
+// Tell the cache which blocks are file system metadata,
+// for the hit counters.
+void
+bsetmeta(uint metaend)
+{
+  acquire(&bcache.lock);
+  bcache.metaend = metaend;
+  release(&bcache.lock);
+}
+
+// Find the cached buffer for dev/blockno, or 0.
+// Caller must hold bcache.lock.
+static struct buf*
+blookup(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  }
+  return 0;
+}
+
+// Is dev/blockno in A1out? If so, forget it there.
+// Caller must hold bcache.lock.
+static int
+a1outhit(uint dev, uint blockno)
+{
+  int i;
+
+  for(i = 0; i < NA1OUT; i++){
+    if(bcache.a1out[i].used && bcache.a1out[i].dev == dev &&
+       bcache.a1out[i].blockno == blockno){
+      bcache.a1out[i].used = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Remember b's block in A1out as it leaves A1in.
+// Caller must hold bcache.lock.
+static void
+a1outadd(struct buf *b)
+{
+  if(!b->valid)
+    return;
+  bcache.a1out[bcache.a1outnext].dev = b->dev;
+  bcache.a1out[bcache.a1outnext].blockno = b->blockno;
+  bcache.a1out[bcache.a1outnext].used = 1;
+  bcache.a1outnext = (bcache.a1outnext + 1) % NA1OUT;
+}
+
+// Pick an unused buffer to replace, or 0 if all are in use.
+// Prefer the oldest A1in block once A1in holds more than its
+// share, otherwise the least recently used Am block.
+// Caller must hold bcache.lock.
+static struct buf*
+bvictim(void)
+{
+  struct buf *b;
+
+  if(bcache.na1in > KIN){
+    for(b = bcache.a1in.prev; b != &bcache.a1in; b = b->prev){
+      if(b->refcnt == 0){
+        a1outadd(b);
+        return b;
+      }
+    }
+  }
+  for(b = bcache.am.prev; b != &bcache.am; b = b->prev){
+    if(b->refcnt == 0)
+      return b;
+  }
+  for(b = bcache.a1in.prev; b != &bcache.a1in; b = b->prev){
+    if(b->refcnt == 0){
+      a1outadd(b);
+      return b;
+    }
   }
+  return 0;
+}
+
+// Give the unused buffer b to block dev/blockno, with one
+// reference, and queue it according to 2Q.
+// Caller must hold bcache.lock.
+static void
+brecycle(struct buf *b, uint dev, uint blockno)
+{
+  if(b->ra)
+    bstatinc(rawasted);
+  b->ra = 0;
+  bunlink(b);
+  if(a1outhit(dev, blockno))
+    bpush(&bcache.am, b);
+  else
+    bpush(&bcache.a1in, b);
+  b->dev = dev;
+  b->blockno = blockno;
+  // 设置为没缓存
+  b->valid = 0;
+  b->refcnt = 1;
 }
 
 // Look through buffer cache for block on device dev.
@@ -64,34 +244,23 @@ bget(uint dev, uint blockno)
 
   // Is the block already cached?
   // 判断这个块是否已经被缓存了
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-	// 获取睡眠锁
-      acquiresleep(&b->lock);
-	// 返回被锁定的buf
-      return b;
-    }
+  if((b = blookup(dev, blockno)) != 0){
+    b->refcnt++;
+    release(&bcache.lock);
+    // 获取睡眠锁
+    acquiresleep(&b->lock);
+    // 返回被锁定的buf
+    return b;
   }
 
-  // 如果还没有缓存 就使用LRU算法寻找最近没使用的buffer
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  // 从尾部开始扫描 因为尾部的是用的最少的 这点在relse函数里面可以看到被释放的buf移动到了头部
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-	// 设置为没缓存
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
-  }
-  panic("bget: no buffers");
+  // Recycle an unused buffer chosen by 2Q.
+  if((b = bvictim()) == 0)
+    panic("bget: no buffers");
+  brecycle(b, dev, blockno);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -101,15 +270,74 @@ bread(uint dev, uint blockno)
   struct buf *b;
 
   b = bget(dev, blockno);
+  bstatinc(bread);
+  if(blockno < bcache.metaend)
+    bstatinc(metaread);
   if(!b->valid) {
   	// 如果没缓存的话 就从磁盘加载进来
     virtio_disk_rw(b, 0);
+    bstatinc(diskread);
 	// 设置为已经缓存了
     b->valid = 1;
+  } else {
+    bstatinc(bhit);
+    if(blockno < bcache.metaend)
+      bstatinc(metahit);
+    if(b->ra)
+      bstatinc(rahit);
   }
+  b->ra = 0;
   return b;
 }
 
+// Start reading the indicated block into the cache, unless
+// it is already cached. Does not wait for the disk: the
+// buffer stays locked until virtio_disk_intr() calls bdone().
+// Gives up quietly if no buffer or descriptor is free, since
+// readahead is only a hint.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  if(blookup(dev, blockno) != 0 || (b = bvictim()) == 0){
+    release(&bcache.lock);
+    return;
+  }
+  brecycle(b, dev, blockno);
+  release(&bcache.lock);
+
+  // refcnt was zero, so no one holds the lock.
+  acquiresleep(&b->lock);
+  b->async = 1;
+  if(virtio_disk_submit(b, b->blockno, 0, 1) < 0){
+    b->async = 0;
+    brelse(b);
+    return;
+  }
+  bstatinc(raissued);
+  bstatinc(diskread);
+}
+
+// Called by virtio_disk_intr() when a read started by
+// breadahead() has finished. Marks the data valid
+// and releases the buffer on behalf of its issuer.
+void
+bdone(struct buf *b)
+{
+  b->async = 0;
+  b->valid = 1;
+  b->ra = 1;
+  releasesleep(&b->lock);
+
+  acquire(&bcache.lock);
+  b->refcnt--;
+  if(b->refcnt == 0 && b->queue == AM)
+    bmru(b);
+  release(&bcache.lock);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -117,10 +345,60 @@ bwrite(struct buf *b)
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   virtio_disk_rw(b, 1);
+  bstatinc(diskwrite);
+}
+
+// Start writing b's contents to disk and return without
+// waiting. b must be locked, and the caller must call
+// bwait(b) before changing b->data or releasing b.
+void
+bwrite_async(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite_async");
+  virtio_disk_submit(b, b->blockno, 1, 0);
+  bstatinc(diskwrite);
+}
+
+// Like bwrite_async(), but write b's contents to disk block
+// blockno rather than to b's own block. The log uses this to
+// copy cached blocks into the on-disk log without a second
+// buffer. Call bwait(b) before releasing b.
+void
+bwriteto(struct buf *b, uint blockno)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwriteto");
+  virtio_disk_submit(b, blockno, 1, 0);
+  bstatinc(diskwrite);
+}
+
+// Wait for a bwrite_async() of b to finish.
+void
+bwait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwait");
+  virtio_disk_wait(b);
+}
+
+// Hold back disk requests until bunplug(), so that a batch
+// of adjacent blocks goes to the disk as one request.
+void
+bplug(void)
+{
+  virtio_disk_plug();
+}
+
+void
+bunplug(void)
+{
+  virtio_disk_unplug();
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// If it is on Am, move to the head of the most-recently-used list;
+// A1in is kept in first-in first-out order.
 void
 brelse(struct buf *b)
 {
@@ -131,15 +409,10 @@ brelse(struct buf *b)
 
   acquire(&bcache.lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
+  if (b->refcnt == 0 && b->queue == AM) {
     // no one is waiting for it.
-    // 将b挪动到链表尾部，因为他free了哈哈
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    // 将b挪动到链表头部，因为他free了哈哈
+    bmru(b);
   }
 
   release(&bcache.lock);
@@ -159,4 +432,19 @@ bunpin(struct buf *b) {
   release(&bcache.lock);
 }
 
-
+// Copy the buffer cache counters into *st.
+void
+bstat(struct iostat *st)
+{
+  acquire(&bcache.lock);
+  st->bread = bcache.stat.bread;
+  st->bhit = bcache.stat.bhit;
+  st->diskread = bcache.stat.diskread;
+  st->diskwrite = bcache.stat.diskwrite;
+  st->raissued = bcache.stat.raissued;
+  st->rahit = bcache.stat.rahit;
+  st->rawasted = bcache.stat.rawasted;
+  st->metaread = bcache.stat.metaread;
+  st->metahit = bcache.stat.metahit;
+  release(&bcache.lock);
+}
@@ -7,7 +7,11 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  int async;   // release buf when the disk finishes (readahead)
+  int ra;      // filled by readahead and not yet used
+  int queue;   // 2Q list holding this buf (bio.c)
+  struct buf *qnext; // next buf in the same disk request
+  struct buf *prev; // 2Q cache list
   struct buf *next;
   uchar data[BSIZE];
 };
@@ -0,0 +1,232 @@
+// Directory entry cache.
+//
+// Remembers the results of recent directory lookups, so that
+// resolving a path whose directories were looked up recently
+// need not read their blocks again.  An entry maps a name in
+// a directory, (dev, directory inode number, name), to the
+// inode number it names, or to 0 if the directory has no such
+// name (a negative entry), which saves searching a whole
+// directory again for a name that isn't there, as PATH-style
+// searches do.
+//
+// Interface:
+// * dclookup looks a name up; it is called by dirlookup().
+// * dcenter records the result of a directory search, or a
+//     new link.
+// * dcinval forgets a name that was unlinked.
+// * dcpurge forgets everything in a directory whose inode
+//     is being freed, since its number will be reused.
+//
+// Names longer than DCNAMELEN are rare, and are not cached,
+// so that an entry need not have room for DIRSIZ bytes.
+//
+// Callers hold the directory's inode lock, which orders the
+// lookups and updates for one directory.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "stat.h"
+
+#define NDHASH 61     // hash chains
+#define DCNAMELEN 27  // longest name cached
+
+struct dentry {
+  uint dev;
+  uint dir;             // directory's inode number; 0 if unused
+  uint inum;            // what name names; 0 if nothing
+  char name[DCNAMELEN+1];
+  struct dentry *hnext; // hash chain
+  struct dentry *prev;  // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry ent[NDCACHE];
+  struct dentry *hash[NDHASH];
+  // head.next is the most recently used entry, head.prev the least.
+  struct dentry head;
+  uint64 hit, neghit, miss;
+} dcache;
+
+void
+dcinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.ent; d < dcache.ent+NDCACHE; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+// Is name short enough to be cached?
+static int
+dcfits(char *name)
+{
+  int i;
+
+  for(i = 0; i <= DCNAMELEN && name[i]; i++)
+    ;
+  return i <= DCNAMELEN;
+}
+
+static uint
+dchash(uint dev, uint dir, char *name)
+{
+  uint h = dev * 31 + dir;
+  int i;
+
+  for(i = 0; i < DCNAMELEN && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Find the entry for name in dir.
+// Caller must hold dcache.lock.
+static struct dentry*
+dcfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dchash(dev, dir, name)]; d; d = d->hnext)
+    if(d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Take d off its hash chain and make it unused.
+// Caller must hold dcache.lock.
+static void
+dcremove(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[dchash(d->dev, d->dir, d->name)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == d){
+      *pp = d->hnext;
+      break;
+    }
+  }
+  d->dir = 0;
+}
+
+// Move d to the front of the LRU list.
+// Caller must hold dcache.lock.
+static void
+dctouch(struct dentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Look name up in directory dir.  Returns 1 and sets *inum if
+// the answer is cached (*inum is 0 if there is no such name),
+// else returns 0.
+int
+dclookup(uint dev, uint dir, char *name, uint *inum)
+{
+  struct dentry *d;
+
+  if(!dcfits(name))
+    return 0;
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    dcache.miss++;
+    release(&dcache.lock);
+    return 0;
+  }
+  dctouch(d);
+  *inum = d->inum;
+  if(d->inum)
+    dcache.hit++;
+  else
+    dcache.neghit++;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in dir names inode inum (0 for none),
+// replacing the least recently used entry if need be.
+void
+dcenter(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *d;
+
+  // "." always names dir itself; don't spend an entry on it.
+  if(namecmp(name, ".") == 0 || !dcfits(name))
+    return;
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    d = dcache.head.prev;
+    if(d->dir)
+      dcremove(d);
+    d->dev = dev;
+    d->dir = dir;
+    safestrcpy(d->name, name, sizeof(d->name));
+    d->hnext = dcache.hash[dchash(dev, dir, name)];
+    dcache.hash[dchash(dev, dir, name)] = d;
+  }
+  d->inum = inum;
+  dctouch(d);
+  release(&dcache.lock);
+}
+
+// Forget name in dir.
+void
+dcinval(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  if(!dcfits(name))
+    return;
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) != 0){
+    dcremove(d);
+    // reuse it first.
+    d->next->prev = d->prev;
+    d->prev->next = d->next;
+    d->prev = dcache.head.prev;
+    d->next = &dcache.head;
+    dcache.head.prev->next = d;
+    dcache.head.prev = d;
+  }
+  release(&dcache.lock);
+}
+
+// Forget everything in directory dir, whose inode is being freed.
+void
+dcpurge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.ent; d < dcache.ent+NDCACHE; d++)
+    if(d->dir == dir && d->dev == dev)
+      dcremove(d);
+  release(&dcache.lock);
+}
+
+// Copy the cache's counters into *st.
+void
+dcstat(struct iostat *st)
+{
+  acquire(&dcache.lock);
+  st->dchit = dcache.hit;
+  st->dcneghit = dcache.neghit;
+  st->dcmiss = dcache.miss;
+  release(&dcache.lock);
+}
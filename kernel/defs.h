@@ -2,6 +2,8 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iostat;
+struct iovec;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -14,8 +16,17 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwrite_async(struct buf*);
+void            bwait(struct buf*);
+void            bwriteto(struct buf*, uint);
+void            bplug(void);
+void            bunplug(void);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            breadahead(uint, uint);
+void            bdone(struct buf*);
+void            bstat(struct iostat*);
+void            bsetmeta(uint);
 
 // console.c
 void            consoleinit(void);
@@ -32,12 +43,29 @@ struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
+int             filedents(struct file*, uint64, int);
+int             filepread(struct file*, uint64, int, uint);
+int             filepwrite(struct file*, uint64, int, uint);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             fileseek(struct file*, int, int);
+int             filesplice(struct file*, struct file*, int);
 int             filewrite(struct file*, uint64, int n);
 
+// dcache.c
+void            dcinit(void);
+int             dclookup(uint, uint, char*, uint*);
+void            dcenter(uint, uint, char*, uint);
+void            dcinval(uint, uint, char*);
+void            dcpurge(uint, uint);
+void            dcstat(struct iostat*);
+
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, uint);
+int             dirread(struct inode*, uint*, uint64, int);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
@@ -53,6 +81,9 @@ int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
+int             setrawindow(int);
+int             iprealloc(struct inode*, uint);
+void            allocstat(struct iostat*);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -68,13 +99,26 @@ void            kinit(void);
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
+int             log_opmax(void);
 void            end_op(void);
+void            logstat(struct iostat*);
+void            log_force(void);
+void            log_data(struct buf*);
+void            log_free(uint);
+int             log_freed(uint);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
 int             pipewrite(struct pipe*, uint64, int);
+int             pipewbegin(struct pipe*, char**, int);
+void            pipewend(struct pipe*, int);
+int             piperbegin(struct pipe*, char**, int, int);
+void            piperend(struct pipe*, int);
+int             pipesize(struct pipe*);
+int             piperesize(struct pipe*, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -100,6 +144,7 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+void            kthread(char*, void (*)(void));
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
@@ -183,6 +228,11 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_submit(struct buf *, uint, int, int);
+void            virtio_disk_wait(struct buf *);
+void            virtio_disk_plug(void);
+void            virtio_disk_unplug(void);
+void            virtio_disk_stat(struct iostat *);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
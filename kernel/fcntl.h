@@ -3,3 +3,18 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// lseek() whence
+#define SEEK_SET  0   // from the start of the file
+#define SEEK_CUR  1   // from the current offset
+#define SEEK_END  2   // from the end of the file
+
+// fcntl() commands
+#define F_GETPIPE_SZ  1  // size of a pipe's buffer
+#define F_SETPIPE_SZ  2  // resize a pipe's buffer; returns the new size
+
+// One piece of the buffer of a readv() or writev().
+struct iovec {
+  void *iov_base;  // start
+  uint iov_len;    // bytes
+};
@@ -12,6 +12,9 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "fcntl.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 struct devsw devsw[NDEV];
 struct {
@@ -105,12 +108,123 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Read up to n bytes of struct dents for the entries of
+// directory f, from f's offset on, into user address addr.
+int
+filedents(struct file *f, uint64 addr, int n)
+{
+  int r;
+
+  if(f->type != FD_INODE || f->readable == 0)
+    return -1;
+  ilock(f->ip);
+  if(f->ip->type == T_DIR)
+    r = dirread(f->ip, &f->off, addr, n);
+  else
+    r = -1;
+  iunlock(f->ip);
+  return r;
+}
+
+// Read from inode file f at *off into the cnt buffers of iov
+// in turn, holding the inode lock throughout, and advance
+// *off.  The buffers are user addresses if user is set,
+// kernel addresses otherwise.  Returns the bytes read.
+static int
+inoderead(struct file *f, struct iovec *iov, int cnt, uint *off, int user)
+{
+  int i, r, tot = 0;
+
+  ilock(f->ip);
+  for(i = 0; i < cnt; i++){
+	//从虚拟地址中读取
+    if((r = readi(f->ip, user, (uint64)iov[i].iov_base, *off, iov[i].iov_len)) < 0){
+      if(tot == 0)
+        tot = -1;
+      break;
+    }
+    *off += r;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  iunlock(f->ip);
+  return tot;
+}
+
+// Write the cnt buffers of iov, user addresses if user is
+// set, to inode file f at *off, one after another, and
+// advance *off.  Returns the number of bytes written, or -1
+// if not all of them could be.
+static int
+inodewrite(struct file *f, struct iovec *iov, int cnt, uint *off, int user)
+{
+  // write as many blocks at a time as one system call
+  // may reserve in the log, including i-node, indirect
+  // blocks (a piece may cross from one to the next at
+  // each of three levels, so up to 6), and allocation
+  // blocks, leaving room for a non-aligned piece to touch
+  // one block more than it has, and reserve only what
+  // each piece touches.  The buffers of a
+  // vector that fits go in one transaction, under one
+  // acquisition of the inode lock.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  // 防止超出块 一次系统调用在log里最多能预留log_opmax()个块
+  int max = ((log_opmax()-1-6-2) / 2) * BSIZE;
+  int i, j, n1, m, r, err;
+  uint done, d;
+
+  i = 0;
+  done = 0;   // bytes of iov[i] written
+  err = 0;
+  while(!err){
+    while(i < cnt && done == iov[i].iov_len){
+      i++;
+      done = 0;
+    }
+    if(i == cnt)
+      break;
+    // the bytes this transaction writes.
+    n1 = 0;
+    for(j = i, d = done; j < cnt && n1 < max; j++, d = 0)
+      n1 += min(iov[j].iov_len - d, max - n1);
+
+    begin_opn(((*off%BSIZE + n1 + BSIZE-1)/BSIZE)*2 + 1 + 6);
+    ilock(f->ip);
+    for(; n1 > 0; n1 -= m){
+      while(done == iov[i].iov_len){
+        i++;
+        done = 0;
+      }
+      m = min(iov[i].iov_len - done, n1);
+      if((r = writei(f->ip, user, (uint64)iov[i].iov_base + done, *off, m)) > 0){
+        *off += r;
+        done += r;
+      }
+      if(r != m){
+        // error from writei
+        err = 1;
+        break;
+      }
+    }
+    iunlock(f->ip);
+    end_op();
+  }
+  if(err)
+    return -1;
+  for(r = 0, j = 0; j < cnt; j++)
+    r += iov[j].iov_len;
+  return r;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 // 根据不同类型读取
 int
 fileread(struct file *f, uint64 addr, int n)
 {
+  struct iovec iov;
   int r = 0;
 //判断是否可读
   if(f->readable == 0)
@@ -123,11 +237,9 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-	//从虚拟地址中读取
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    iov.iov_base = (void*)addr;
+    iov.iov_len = n;
+    r = inoderead(f, &iov, 1, &f->off, 1);
   } else {
     panic("fileread");
   }
@@ -141,7 +253,8 @@ fileread(struct file *f, uint64 addr, int n)
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  struct iovec iov;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
@@ -153,34 +266,11 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    // 防止超出块 因为我们一次log最大操作的块已经确定好了
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r != n1){
-        // error from writei
-        break;
-      }
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    if(n < 0)
+      return -1;
+    iov.iov_base = (void*)addr;
+    iov.iov_len = n;
+    ret = inodewrite(f, &iov, 1, &f->off, 1);
   } else {
     panic("filewrite");
   }
@@ -188,3 +278,207 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Read from file f at offset off, which f's offset does not
+// change, like pread().  Only inode files have offsets.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inoderead(f, &iov, 1, &off, 1);
+}
+
+// Write to file f at offset off, like pwrite().
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->writable == 0 || f->type != FD_INODE || n < 0)
+    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inodewrite(f, &iov, 1, &off, 1);
+}
+
+// Read from file f into the cnt user buffers of iov in turn.
+// An inode file is read under one acquisition of its lock.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_INODE)
+    return inoderead(f, iov, cnt, &f->off, 1);
+  // pipes and devices: a buffer at a time, until one comes up short.
+  for(tot = 0, i = 0; i < cnt; i++){
+    if((r = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+// Write the cnt user buffers of iov to file f, one after
+// another.  An inode file gets one transaction and one
+// acquisition of its lock for as much of the vector as one
+// transaction can hold.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_INODE)
+    return inodewrite(f, iov, cnt, &f->off, 1);
+  for(tot = 0, i = 0; i < cnt; i++){
+    if((r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+      return -1;
+    tot += r;
+  }
+  return tot;
+}
+
+// Set the offset of inode file f to off, counted as whence
+// says.  Files have no holes, so the offset may not go past
+// the end of the file.  Returns the new offset.
+int
+fileseek(struct file *f, int off, int whence)
+{
+  long base, pos;
+  int r;
+
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  if(whence == SEEK_SET)
+    base = 0;
+  else if(whence == SEEK_CUR)
+    base = f->off;
+  else if(whence == SEEK_END)
+    base = f->ip->size;
+  else
+    base = -1;
+  // in 64 bits, so that a large off can't overflow.
+  pos = base + off;
+  r = -1;
+  if(base >= 0 && pos >= 0 && pos <= f->ip->size){
+    f->off = pos;
+    r = f->off;
+  }
+  iunlock(f->ip);
+  return r;
+}
+
+// Write n bytes at kernel address src to inode or device
+// file out.  Returns the number written, or -1.
+static int
+kwrite(struct file *out, char *src, int n)
+{
+  struct iovec iov;
+
+  if(out->type == FD_INODE){
+    iov.iov_base = src;
+    iov.iov_len = n;
+    return inodewrite(out, &iov, 1, &out->off, 0);
+  }
+  if(out->major < 0 || out->major >= NDEV || !devsw[out->major].write)
+    return -1;
+  return devsw[out->major].write(0, (uint64)src, n);
+}
+
+// Move up to n bytes from file in to file out inside the
+// kernel, for sendfile() and splice().  From an inode file
+// to a pipe, readi() copies straight out of the buffer cache
+// into the pipe's buffer; from a pipe to an inode file,
+// writei() copies straight out of the pipe's buffer, taking
+// what is in the pipe once some arrives, like read().  Other
+// pairs go through a kernel page.  Returns the number of
+// bytes moved.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  struct inode *ip;
+  struct iovec iov;
+  char *p;
+  int m, r, tot;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type == FD_PIPE && out->type == FD_PIPE)
+    return -1;
+  if(in->type != FD_PIPE && in->type != FD_INODE)
+    return -1;
+
+  tot = 0;
+  if(in->type == FD_INODE && out->type == FD_PIPE){
+    ip = in->ip;
+    while(tot < n){
+      if((m = pipewbegin(out->pipe, &p, n - tot)) < 0)
+        return tot > 0 ? tot : -1;
+      ilock(ip);
+      if((r = readi(ip, 0, (uint64)p, in->off, m)) > 0)
+        in->off += r;
+      iunlock(ip);
+      pipewend(out->pipe, r > 0 ? r : 0);
+      if(r < 0)
+        return tot > 0 ? tot : -1;
+      tot += r;
+      if(r < m)
+        break;
+    }
+    return tot;
+  }
+
+  if(in->type == FD_PIPE){
+    while(tot < n){
+      if((m = piperbegin(in->pipe, &p, n - tot, tot == 0)) <= 0){
+        if(m < 0 && tot == 0)
+          return -1;
+        break;
+      }
+      r = kwrite(out, p, m);
+      piperend(in->pipe, r > 0 ? r : 0);
+      if(r < 0)
+        return tot > 0 ? tot : -1;
+      tot += r;
+      if(r < m)
+        break;
+    }
+    return tot;
+  }
+
+  // inode file to inode file or device.
+  if((p = kalloc()) == 0)
+    return -1;
+  while(tot < n){
+    iov.iov_base = p;
+    iov.iov_len = min(n - tot, PGSIZE);
+    if((r = inoderead(in, &iov, 1, &in->off, 0)) <= 0){
+      if(r < 0 && tot == 0)
+        tot = -1;
+      break;
+    }
+    if((m = kwrite(out, p, r)) != r){
+      if(m > 0)
+        tot += m;
+      else if(tot == 0)
+        tot = -1;
+      break;
+    }
+    tot += r;
+    if(r < iov.iov_len)
+      break;
+  }
+  kfree(p);
+  return tot;
+}
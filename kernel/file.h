@@ -19,8 +19,17 @@ struct inode {
   uint inum;          // Inode number
   // 引用计数
   int ref;            // Reference count
+  struct inode *hnext; // hash chain
+  struct inode *prev; // LRU of unreferenced inodes, or free list
+  struct inode *next;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint ranext;        // block a sequential reader asks for next
+  uint raend;         // last block readahead has been started for
+  struct extent ecache; // last extent bmap used (FS_EXTENTS)
+  int pawin;          // blocks the next allocation takes (preallocation window)
+  uint paend;         // block after the last one a window mapped, 0 if none
+  int nblocks;        // disk blocks held (see iblocks()), -1 until counted
 
 // 下面的从disk上的inode结构体来的
   short type;         // copy of disk inode
@@ -28,7 +37,11 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint flags;
+  union {
+    uint addrs[NDIRECT+3];
+    char data[NINLINE];
+  };
 };
 
 // map major device number to device functions.
@@ -26,6 +26,9 @@
 // only one device
 struct superblock sb;
 
+static void bginit(int);
+static void imapinit(int);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -46,55 +49,217 @@ fsinit(int dev) {
 // 判断是否读取正确
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  // everything before the data blocks is metadata
+  bsetmeta(sb.size - sb.nblocks);
   // 初始化日志层
   initlog(dev, &sb);
+  // after recovery, which may change the bitmap
+  bginit(dev);
+  imapinit(dev);
 }
 
+// What balloc() does with the old contents of a new block.
+#define BMETA 0  // zero it through the log
+#define BDATA 1  // zero it as file data, with log_data()
+#define BKEEP 2  // leave it: preallocated past the end of a file,
+                 // so it will be written before it can be read
+
 // Zero a block.
 static void
-bzero(int dev, int bno)
+bzero(int dev, int bno, int data)
 {
   struct buf *bp;
+
+  if(data == BKEEP)
+    return;
 //清空一个块
   bp = bread(dev, bno);
   memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  if(data)
+    log_data(bp);
+  else
+    log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
 
-// Allocate a zeroed disk block.
-// returns 0 if out of disk space.
+// The allocator divides the disk into groups of bg.size blocks
+// and keeps, in memory, how many blocks of each group are free
+// and where to resume searching in it (a next-fit cursor).
+// balloc() skips full groups without reading their bitmap, and
+// a search starts where the last one in that group stopped
+// rather than at block 0.  The counts are built from the bitmap
+// at mount time.
+struct {
+  struct spinlock lock;
+  uint size;            // blocks per group
+  uint ngroup;
+  int nfree[NBGROUP];   // free blocks in each group
+  uint next[NBGROUP];   // where to start looking in each group
+  uint rotor;           // group for allocations without a goal
+  uint64 nalloc;        // blocks allocated
+  uint64 nscan;         // bitmap blocks examined to allocate them
+  uint64 nprealloc;     // blocks allocated ahead of a file's writes
+} bg;
+
+// Build the per-group free counts from the bitmap.
+static void
+bginit(int dev)
+{
+  uint b, bi, g;
+  struct buf *bp;
+
+  initlock(&bg.lock, "bgroup");
+  bg.size = BGBLOCKS;
+  while(bg.size * NBGROUP < sb.size)
+    bg.size *= 2;
+  bg.ngroup = (sb.size + bg.size - 1) / bg.size;
+  for(g = 0; g < bg.ngroup; g++)
+    bg.next[g] = g * bg.size;
+  for(b = 0; b < sb.size; b += BPB){
+    bp = bread(dev, BBLOCK(b, sb));
+    for(bi = 0; bi < BPB && b + bi < sb.size; bi++)
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        bg.nfree[(b + bi) / bg.size]++;
+    brelse(bp);
+  }
+}
+
+// Allocate the first free block in [from, to), zeroed, and
+// up to want-1 free blocks right after it in the same bitmap
+// block, which are left as they are; sets *got to the number.
+// Blocks freed by a transaction that has not committed yet do
+// not count as free (see log_free()).
+// *nscan counts the bitmap blocks read.
+// returns 0 if there is none.
 static uint
-balloc(uint dev)
+bscan(uint dev, uint from, uint to, int data, int want, int *got, int *nscan)
 {
-  int b, bi, m;
+  int b, bi, m, n;
   struct buf *bp;
 
   bp = 0;
   // 遍历位图块 b代表bit每次for循环增加8096个位
-  for(b = 0; b < sb.size; b += BPB){
+  for(b = from - from % BPB; b < to; b += BPB){
   	// 读取该位图存放的块的buf
     bp = bread(dev, BBLOCK(b, sb));
+    (*nscan)++;
 	// 遍历所有位
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+    for(bi = (b < from ? from - b : 0); bi < BPB && b + bi < to; bi++){
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
+      if((bp->data[bi/8] & m) == 0 && !log_freed(b + bi)){  // Is block free?
       // 如果操作一个位都要提交一次 效率有点太低了吧
         bp->data[bi/8] |= m;  // Mark block in use.
+        for(n = 1; n < want && bi + n < BPB && b + bi + n < to; n++){
+          m = 1 << ((bi + n) % 8);
+          if((bp->data[(bi + n)/8] & m) || log_freed(b + bi + n))
+            break;
+          bp->data[(bi + n)/8] |= m;
+        }
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        bzero(dev, b + bi, data);
+        *got = n;
         return b + bi;
       }
     }
     brelse(bp);
   }
-  printf("balloc: out of blocks\n");
   return 0;
 }
 
+// Allocate a disk block: the first free one at or after
+// goal in goal's group, so that a file's blocks are contiguous,
+// else one from the next group with free blocks, starting at
+// that group's cursor.  With no goal, start at the cursor of
+// the group the last such allocation came from.
+// data is BMETA, BDATA or BKEEP.
+// If want > 1, also allocate up to want-1 blocks right after it
+// for the caller to fill in later, without zeroing them, and set
+// *got to the number allocated; they all come from one bitmap
+// block, so the allocation logs just that block.
+// returns 0 if out of disk space.
+static uint
+ballocn(uint dev, uint goal, int data, int want, int *got)
+{
+  uint b, g, i, start, end, from;
+  int nscan, nogoal;
+
+  nscan = 0;
+  b = 0;
+  *got = 0;
+  acquire(&bg.lock);
+  nogoal = (goal == 0 || goal >= sb.size);
+  if(nogoal)
+    goal = bg.next[bg.rotor];
+  g = goal / bg.size;
+  for(i = 0; i < bg.ngroup; i++, g = (g + 1) % bg.ngroup){
+    if(bg.nfree[g] <= 0)
+      continue;
+    start = g * bg.size;
+    end = min(start + bg.size, sb.size);
+    from = (i == 0) ? goal : bg.next[g];
+    release(&bg.lock);
+    if((b = bscan(dev, from, end, data, want, got, &nscan)) == 0 && from > start)
+      b = bscan(dev, start, from, data, want, got, &nscan);
+    acquire(&bg.lock);
+    if(b){
+      bg.nfree[g] -= *got;
+      bg.next[g] = (b + *got < end) ? b + *got : start;
+      if(nogoal)
+        bg.rotor = g;
+      break;
+    }
+    // lost a race for the group's last free blocks.
+  }
+  if(b){
+    bg.nalloc += *got;
+    bg.nprealloc += *got - 1;
+  }
+  bg.nscan += nscan;
+  release(&bg.lock);
+  if(b == 0)
+    printf("balloc: out of blocks\n");
+  return b;
+}
+
+// Allocate one block, zeroed as data says.
+static uint
+balloc(uint dev, uint goal, int data)
+{
+  int got;
+
+  return ballocn(dev, goal, data, 1, &got);
+}
+
+// ip got n more disk blocks, or gave back -n; keep its count,
+// once stati() has made one.
+static void
+icount(struct inode *ip, int n)
+{
+  if(ip->nblocks >= 0)
+    ip->nblocks += n;
+}
+
+// Where to try to put a new block of ip: just after prev, the
+// block before it in the file, or if there is none, in the group
+// that ip's inode number maps to.  Inode numbers are spread
+// evenly over the groups, so files created together, which get
+// nearby inode numbers, are placed near each other.
+static uint
+bgoal(struct inode *ip, uint prev)
+{
+  uint g;
+
+  if(prev)
+    return prev + 1;
+  g = (uint64)ip->inum * bg.ngroup / sb.ninodes;
+  if(g == 0)
+    return sb.size - sb.nblocks;  // first data block
+  return g * bg.size;
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -114,6 +279,10 @@ bfree(int dev, uint b)
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+  log_free(b);
+  acquire(&bg.lock);
+  bg.nfree[b / bg.size]++;
+  release(&bg.lock);
 }
 
 // Inodes.
@@ -141,18 +310,21 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a table entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in table: ip->ref tracks the number of
+//   in-memory pointers to a table entry (open files and
+//   current directories). iget() finds or creates a table
+//   entry and increments its ref; iput() decrements ref.
+//   An entry whose ref falls to zero stays in the table,
+//   on an LRU list, until its slot is needed for another
+//   inode, so an inode used again soon is found there.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid.  It stays valid while the entry is on the
+//   LRU list, so ilock() after iget() of such an inode
+//   does not read the disk; iput() clears ip->valid when
+//   it frees the inode.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -176,32 +348,251 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// The table is a hash table keyed by (dev, inum), with a
+// spin-lock per bucket.  A bucket's lock protects the hash
+// chain, and ip->ref, ip->dev and ip->inum of the inodes on
+// it; one must hold it while using any of those fields.
+// Entries are allocated a page at a time, as they are
+// needed: the table holds at least NINODE entries before it
+// reuses unreferenced ones, and more if that many are in use.
+// icache.lock protects the LRU and free lists and is taken
+// after a bucket lock, never before.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
-// read or write that inode's ip->valid, ip->size, ip->type, &c.
+// dev, inum and the list pointers.  One must hold ip->lock in
+// order to read or write that inode's ip->valid, ip->size,
+// ip->type, &c.
+
+#define NIHASH 31
+
+struct {
+  struct spinlock lock;
+  struct inode *head;
+} itable[NIHASH];
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
-} itable;
+  // unreferenced inodes still in the table; lru.next is the
+  // most recently used, lru.prev the least.
+  struct inode lru;
+  struct inode *free;  // entries holding no inode, through next
+  int n;               // entries allocated
+  int nlru;
+  uint64 nget;         // iget() calls
+  uint64 nhit;         // ... that found the inode in the table
+  uint64 nunline;      // inline files moved out to a block
+} icache;
+
+#define istatinc(x) __sync_fetch_and_add(&icache.x, 1)
 
 void
 iinit()
 {
   int i = 0;
 
-  initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+  for(i = 0; i < NIHASH; i++)
+    initlock(&itable[i].lock, "itable");
+  initlock(&icache.lock, "icache");
+  icache.lru.prev = &icache.lru;
+  icache.lru.next = &icache.lru;
+}
+
+static struct spinlock*
+ibucket(uint dev, uint inum)
+{
+  return &itable[(dev * 7 + inum) % NIHASH].lock;
+}
+
+static struct inode**
+ichain(uint dev, uint inum)
+{
+  return &itable[(dev * 7 + inum) % NIHASH].head;
+}
+
+// Caller must hold icache.lock.
+static void
+lruremove(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+  icache.nlru--;
+}
+
+// Caller must hold icache.lock.
+static void
+lrupush(struct inode *ip)
+{
+  ip->next = icache.lru.next;
+  ip->prev = &icache.lru;
+  icache.lru.next->prev = ip;
+  icache.lru.next = ip;
+  icache.nlru++;
+}
+
+// Caller must hold icache.lock.
+static void
+ifreepush(struct inode *ip)
+{
+  ip->dev = 0;
+  ip->inum = 0;
+  ip->next = icache.free;
+  icache.free = ip;
+}
+
+// Take ip, whose bucket lock the caller holds, off its hash chain.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = ichain(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+    ;
+  *pp = ip->hnext;
+}
+
+// Add a page of entries to the free list.
+// Caller must hold icache.lock.
+static void
+igrow(void)
+{
+  struct inode *ip;
+  char *page;
+
+  if((page = kalloc()) == 0)
+    panic("iget: no inodes");
+  memset(page, 0, PGSIZE);
+  for(ip = (struct inode*)page; (char*)(ip + 1) <= page + PGSIZE; ip++){
+    initsleeplock(&ip->lock, "inode");
+    ifreepush(ip);
+    icache.n++;
+  }
+}
+
+// Return an entry that holds no inode: a free one, a new one
+// if the table is below NINODE entries or none is unreferenced,
+// else the least recently used unreferenced one.
+static struct inode*
+inew(void)
+{
+  struct inode *ip;
+  struct spinlock *lk;
+  uint dev, inum;
+
+  for(;;){
+    acquire(&icache.lock);
+    if(icache.free == 0 && (icache.n < NINODE || icache.nlru == 0))
+      igrow();
+    if((ip = icache.free) != 0){
+      icache.free = ip->next;
+      release(&icache.lock);
+      return ip;
+    }
+    ip = icache.lru.prev;
+    dev = ip->dev;
+    inum = ip->inum;
+    release(&icache.lock);
+
+    // take the bucket lock first, then make sure that ip is
+    // still unreferenced and still holds the same inode.
+    lk = ibucket(dev, inum);
+    acquire(lk);
+    acquire(&icache.lock);
+    if(ip->ref == 0 && ip->dev == dev && ip->inum == inum){
+      lruremove(ip);
+      iunhash(ip);
+      release(&icache.lock);
+      release(lk);
+      return ip;
+    }
+    release(&icache.lock);
+    release(lk);
   }
 }
 
 static struct inode* iget(uint dev, uint inum);
+static void itrim(struct inode*);
+
+// Which inodes are allocated, kept in memory so that ialloc()
+// need not read every inode block to find a free one.  Built
+// from the inode blocks at mount time.  A set bit means the
+// inode is in use; imap.next is the lowest inode number that
+// may be free.
+struct {
+  struct spinlock lock;
+  uchar used[MAXINODES/8];
+  uint next;
+  uint nfree;
+} imap;
+
+static void
+imapinit(int dev)
+{
+  uint inum;
+  struct buf *bp;
+  struct dinode *dip;
+
+  if(sb.ninodes > MAXINODES)
+    panic("imapinit: too many inodes");
+  initlock(&imap.lock, "imap");
+  imap.used[0] |= 1;  // inode 0 is never used
+  imap.next = 1;
+  bp = 0;
+  for(inum = 1; inum < sb.ninodes; inum++){
+    if(bp == 0 || inum % IPB == 0){
+      if(bp)
+        brelse(bp);
+      bp = bread(dev, IBLOCK(inum, sb));
+    }
+    dip = (struct dinode*)bp->data + inum%IPB;
+    if(dip->type != 0)
+      imap.used[inum/8] |= 1 << (inum % 8);
+    else
+      imap.nfree++;
+  }
+  if(bp)
+    brelse(bp);
+}
+
+// Mark inode inum free in the map.
+static void
+imapfree(uint inum)
+{
+  acquire(&imap.lock);
+  if((imap.used[inum/8] & (1 << (inum % 8))) == 0)
+    panic("imapfree");
+  imap.used[inum/8] &= ~(1 << (inum % 8));
+  imap.nfree++;
+  if(inum < imap.next)
+    imap.next = inum;
+  release(&imap.lock);
+}
+
+// Copy the block and inode allocator and inode table
+// counters into *st.
+void
+allocstat(struct iostat *st)
+{
+  uint g;
+
+  acquire(&bg.lock);
+  st->nfree = 0;
+  for(g = 0; g < bg.ngroup; g++)
+    st->nfree += bg.nfree[g];
+  st->nalloc = bg.nalloc;
+  st->nbscan = bg.nscan;
+  st->nprealloc = bg.nprealloc;
+  release(&bg.lock);
+  st->fsflags = sb.flags;
+  acquire(&imap.lock);
+  st->nifree = imap.nfree;
+  release(&imap.lock);
+  acquire(&icache.lock);
+  st->ninode = icache.n;
+  st->niget = icache.nget;
+  st->nigethit = icache.nhit;
+  st->nunline = icache.nunline;
+  release(&icache.lock);
+}
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -212,29 +603,41 @@ static struct inode* iget(uint dev, uint inum);
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  uint inum;
   struct buf *bp;
   struct dinode *dip;
-// 遍历每一个inode
-  for(inum = 1; inum < sb.ninodes; inum++){
-  	// 读取出来该inode对应的块
-    bp = bread(dev, IBLOCK(inum, sb));
-	// 一个块内有多个inode 找到对应的inode
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-    	// 清空inode
-      memset(dip, 0, sizeof(*dip));
-	// 设置类型
-	dip->type = type;
-	// 在磁盘上标记这个inode被使用了
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
-    }
-    brelse(bp);
+
+  // 在内存的位图中找一个空闲的inode 不用读取inode块
+  acquire(&imap.lock);
+  for(inum = imap.next; inum < sb.ninodes; inum++)
+    if((imap.used[inum/8] & (1 << (inum % 8))) == 0)
+      break;
+  if(inum >= sb.ninodes){
+    imap.next = inum;
+    release(&imap.lock);
+    printf("ialloc: no inodes\n");
+    return 0;
   }
-  printf("ialloc: no inodes\n");
-  return 0;
+  imap.used[inum/8] |= 1 << (inum % 8);
+  imap.next = inum + 1;
+  imap.nfree--;
+  release(&imap.lock);
+
+  // 读取出来该inode对应的块
+  bp = bread(dev, IBLOCK(inum, sb));
+  dip = (struct dinode*)bp->data + inum%IPB;
+  if(dip->type != 0)
+    panic("ialloc: inode in use");
+  // 清空inode
+  memset(dip, 0, sizeof(*dip));
+  // 设置类型
+  dip->type = type;
+  if(type == T_FILE && (sb.flags & FS_INLINE))
+    dip->flags = DI_INLINE;
+  // 在磁盘上标记这个inode被使用了
+  log_write(bp);   // mark it allocated on the disk
+  brelse(bp);
+  return iget(dev, inum);
 }
 
 // Copy a modified in-memory inode to disk.
@@ -255,7 +658,8 @@ iupdate(struct inode *ip)
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
-  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  dip->flags = ip->flags;
+  memmove(dip->data, ip->data, sizeof(ip->data));
   log_write(bp);
   brelse(bp);
 }
@@ -266,34 +670,55 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
-
-  acquire(&itable.lock);
-
-  // Is the inode already in the table?
-  empty = 0;
-  // 查看这个inode是否已经在表中了
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
+  struct inode *ip, *new;
+  struct spinlock *lk = ibucket(dev, inum);
+
+  istatinc(nget);
+  new = 0;
+  acquire(lk);
+  for(;;){
+    // Is the inode already in the table?
+    // 查看这个inode是否已经在表中了
+    for(ip = *ichain(dev, inum); ip; ip = ip->hnext){
+      if(ip->dev == dev && ip->inum == inum){
+        if(ip->ref == 0 || new){
+          acquire(&icache.lock);
+          if(ip->ref == 0)
+            lruremove(ip);
+          if(new)
+            ifreepush(new);
+          release(&icache.lock);
+        }
+        ip->ref++;
+        release(lk);
+        istatinc(nhit);
+        return ip;
+      }
     }
-	// 在表里面找一个位置
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    if(new)
+      break;
+    // get an entry without holding the bucket lock, since
+    // reusing one takes another bucket's lock; then look again.
+    release(lk);
+    new = inew();
+    acquire(lk);
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-// 将从表里面找的位置的inode设置为要get的inode
-  ip = empty;
+// 将找到的位置设置为要get的inode
+  ip = new;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&itable.lock);
+  ip->ranext = 0;
+  ip->ecache.len = 0;
+  ip->raend = 0;
+  ip->pawin = 1;
+  ip->paend = 0;
+  ip->nblocks = -1;
+  ip->hnext = *ichain(dev, inum);
+  *ichain(dev, inum) = ip;
+  release(lk);
 
   return ip;
 }
@@ -304,9 +729,11 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct spinlock *lk = ibucket(ip->dev, ip->inum);
+
+  acquire(lk);
   ip->ref++;
-  release(&itable.lock);
+  release(lk);
   return ip;
 }
 
@@ -334,8 +761,9 @@ ilock(struct inode *ip)
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
-	// 将对应的块号拷贝一下
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->flags = dip->flags;
+	// 将对应的块号拷贝一下, or the data of an inline file
+    memmove(ip->data, dip->data, sizeof(ip->data));
     brelse(bp);
     ip->valid = 1;
     if(ip->type == 0)
@@ -363,8 +791,19 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct spinlock *lk = ibucket(ip->dev, ip->inum);
+
+  acquire(lk);
  // 判断是否只有一个引用 并且没有链接
+  if(ip->ref == 1 && ip->valid && ip->nlink > 0 && ip->paend > 0){
+    // the last reference to a file that was growing: give
+    // back what its preallocation window mapped past the end.
+    acquiresleep(&ip->lock);
+    release(lk);
+    itrim(ip);
+    releasesleep(&ip->lock);
+    acquire(lk);
+  }
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
 
@@ -374,22 +813,37 @@ iput(struct inode *ip)
     // 所以不会造成死锁 这一行也不会锁定
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    release(lk);
 // 清空该inode对应的块的内容
     itrunc(ip);
+    // its number will be reused; forget what it held.
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
 // 清空类型且更新
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
+    imapfree(ip->inum);
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquire(lk);
   }
 // 减少引用
   ip->ref--;
+  if(ip->ref == 0){
+    // keep a valid inode in the table for the next iget().
+    acquire(&icache.lock);
+    if(ip->valid){
+      lrupush(ip);
+    } else {
+      iunhash(ip);
+      ifreepush(ip);
+    }
+    release(&icache.lock);
+  }
   // 释放
-  release(&itable.lock);
+  release(lk);
 }
 
 // Common idiom: unlock, then put.
@@ -405,60 +859,584 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The next NDINDIRECT
+// are reached through the double-indirect block
+// ip->addrs[NDIRECT+1], which lists indirect blocks, and the
+// last NTINDIRECT through the triple-indirect block
+// ip->addrs[NDIRECT+2], which lists double-indirect blocks.
+
+// Return the disk block address of block bn of the tree of
+// indirect blocks, level levels deep, whose root is *root,
+// allocating any missing blocks along the way, and up to
+// want-1 data blocks after bn in the same indirect block;
+// *got is set to the number of data blocks allocated.
+// returns 0 if out of disk space.
+static uint
+bmapind(struct inode *ip, uint *root, uint bn, int level, int want, int data, int *got)
+{
+  int n;
+  uint addr, *a, span, i;
+  struct buf *bp;
+
+  if((addr = *root) == 0){
+    addr = balloc(ip->dev, bgoal(ip, ip->addrs[NDIRECT-1]), 0);
+    if(addr == 0)
+      return 0;
+    *root = addr;
+    icount(ip, 1);
+  }
+  // each entry of the root covers span blocks.
+  for(span = 1, i = 1; i < level; i++)
+    span *= NINDIRECT;
+  for(; level > 0; level--, span /= NINDIRECT){
+	// 读取间接块
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    i = bn / span;
+    bn %= span;
+    if((addr = a[i]) == 0){
+      // only the last level points at file data, which
+      // goes after the block before it, or after the
+      // indirect block itself.
+      if(level == 1){
+        addr = ballocn(ip->dev, bgoal(ip, i > 0 && a[i-1] ? a[i-1] : addr),
+                       data, min(want, NINDIRECT - i), got);
+        for(n = 0; addr && n < *got; n++)
+          a[i+n] = addr + n;
+        icount(ip, *got);
+      } else {
+        addr = balloc(ip->dev, bgoal(ip, i > 0 && a[i-1] ? a[i-1] : addr), BMETA);
+        if(addr){
+          a[i] = addr;
+          icount(ip, 1);
+        }
+      }
+      if(addr)
+        log_write(bp);
+    }
+    brelse(bp);
+    if(addr == 0)
+      return 0;
+  }
+  return addr;
+}
+
+// Extents.
+//
+// On a file system with FS_EXTENTS, bmap() looks blocks up in
+// the inode's extent tree instead, and keeps the extent it found
+// in ip->ecache, so a sequential reader walks the tree once per
+// extent rather than once per block. Files only grow at the end
+// (writei() never skips past ip->size), so new extents are always
+// added at the right edge of the tree, and a new block goes right
+// after the file's last one when that is free, growing the last
+// extent instead of adding one.
+
+#define EXTROOT(ip) ((struct exthdr*)(ip)->addrs)
+#define EXTENTS(h)  ((struct extent*)((struct exthdr*)(h) + 1))
+
+// Return the entry of node h that covers file block bn:
+// the last one starting at or before it. h->n must be > 0.
+static struct extent*
+extfind(struct exthdr *h, uint bn)
+{
+  struct extent *e = EXTENTS(h);
+  int lo = 0, hi = h->n - 1, mid;
+
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(e[mid].lblk <= bn)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return &e[lo];
+}
+
+// Return the disk block holding file block bn of ip,
+// or 0 if bn is not mapped.
+static uint
+extlookup(struct inode *ip, uint bn)
+{
+  struct exthdr *h = EXTROOT(ip);
+  struct extent e = ip->ecache;
+  struct buf *bp = 0;
+  int depth;
+
+  if(e.len > 0 && bn >= e.lblk && bn - e.lblk < e.len)
+    return e.pblk + (bn - e.lblk);
+  if(h->n == 0)
+    return 0;
+  for(;;){
+    e = *extfind(h, bn);
+    depth = h->depth;
+    if(bp)
+      brelse(bp);
+    if(depth == 0)
+      break;
+    // 读取下一层的节点
+    bp = bread(ip->dev, e.pblk);
+    h = (struct exthdr*)bp->data;
+    if(h->n == 0)
+      panic("extlookup");
+  }
+  if(bn < e.lblk || bn - e.lblk >= e.len)
+    return 0;
+  ip->ecache = e;
+  return e.pblk + (bn - e.lblk);
+}
+
+// Add extent *e, which starts after every mapped block, at the
+// right edge of ip's extent tree, adding a level to the tree if
+// every node on that edge is full.
+// returns 0 if out of disk space.
+static int
+extappend(struct inode *ip, struct extent *e)
+{
+  struct exthdr *root = EXTROOT(ip), *h;
+  struct extent ent;
+  struct buf *bp;
+  uint path[EXTMAXDEPTH], nodes[EXTMAXDEPTH], child;
+  int d, k;
+
+  for(;;){
+    // walk down the right edge; k is the lowest level with room.
+    k = (root->n < NIEXTENT) ? root->depth : -1;
+    h = root;
+    bp = 0;
+    for(d = root->depth; d > 0; d--){
+      child = EXTENTS(h)[h->n-1].pblk;
+      if(bp)
+        brelse(bp);
+      bp = bread(ip->dev, child);
+      h = (struct exthdr*)bp->data;
+      path[d-1] = child;
+      if(h->n < NBEXTENT)
+        k = d-1;
+    }
+    if(bp)
+      brelse(bp);
+    if(k >= 0)
+      break;
+
+    // move the root's entries into a new node below it.
+    if(root->depth + 1 >= EXTMAXDEPTH)
+      return 0;
+    if((child = balloc(ip->dev, bgoal(ip, 0), 0)) == 0)
+      return 0;
+    icount(ip, 1);
+    bp = bread(ip->dev, child);
+    memmove(bp->data, root, sizeof(*root) + root->n * sizeof(struct extent));
+    log_write(bp);
+    brelse(bp);
+    ent.lblk = EXTENTS(root)[0].lblk;
+    ent.pblk = child;
+    ent.len = 0;
+    root->depth++;
+    root->n = 1;
+    EXTENTS(root)[0] = ent;
+  }
+
+  // new nodes for the levels below k, each with one entry.
+  for(d = 0; d < k; d++){
+    if((nodes[d] = balloc(ip->dev, bgoal(ip, 0), 0)) == 0){
+      while(--d >= 0)
+        bfree(ip->dev, nodes[d]);
+      return 0;
+    }
+  }
+  icount(ip, k);
+  ent = *e;
+  for(d = 0; d < k; d++){
+    bp = bread(ip->dev, nodes[d]);
+    h = (struct exthdr*)bp->data;
+    h->n = 1;
+    h->depth = d;
+    EXTENTS(h)[0] = ent;
+    log_write(bp);
+    brelse(bp);
+    ent.pblk = nodes[d];
+    ent.len = 0;
+  }
+
+  // the caller's iupdate() writes the root.
+  if(k == root->depth){
+    EXTENTS(root)[root->n++] = ent;
+  } else {
+    bp = bread(ip->dev, path[k]);
+    h = (struct exthdr*)bp->data;
+    EXTENTS(h)[h->n++] = ent;
+    log_write(bp);
+    brelse(bp);
+  }
+  return 1;
+}
+
+// bmap() for FS_EXTENTS.
+static uint
+bmapext(struct inode *ip, uint bn, int want, int data, int *got)
+{
+  struct exthdr *h = EXTROOT(ip);
+  struct extent *last, e;
+  struct buf *bp = 0;
+  uint addr, goal;
+  int n;
+
+  if((addr = extlookup(ip, bn)) != 0)
+    return addr;
+
+  // bn is the block after the file's last one; find the
+  // last extent, at the bottom of the right edge.
+  while(h->n > 0 && h->depth > 0){
+    addr = EXTENTS(h)[h->n-1].pblk;
+    if(bp)
+      brelse(bp);
+    bp = bread(ip->dev, addr);
+    h = (struct exthdr*)bp->data;
+  }
+  last = h->n > 0 ? &EXTENTS(h)[h->n-1] : 0;
+  if(last && last->lblk + last->len != bn)
+    panic("bmapext");
+  goal = last ? last->pblk + last->len : bgoal(ip, 0);
+
+  // 申请一个块 尽量紧跟在最后一个extent后面
+  addr = ballocn(ip->dev, goal, data, want, got);
+  icount(ip, *got);
+  if(addr != 0 && last && addr == goal){
+    last->len += *got;
+    if(bp)
+      log_write(bp);
+    ip->ecache = *last;
+  }
+  if(bp)
+    brelse(bp);
+  if(addr == 0 || (last && addr == goal))
+    return addr;
+
+  e.lblk = bn;
+  e.pblk = addr;
+  e.len = *got;
+  if(extappend(ip, &e) == 0){
+    for(n = 0; n < *got; n++)
+      bfree(ip->dev, addr + n);
+    icount(ip, -*got);
+    *got = 0;
+    return 0;
+  }
+  ip->ecache = e;
+  return addr;
+}
+
+// Free the blocks that node h maps, and the nodes below it.
+static void
+extfree(struct inode *ip, struct exthdr *h)
+{
+  struct extent *e = EXTENTS(h);
+  struct buf *bp;
+  uint b;
+  int i;
+
+  for(i = 0; i < h->n; i++){
+    if(h->depth == 0){
+      for(b = 0; b < e[i].len; b++)
+        bfree(ip->dev, e[i].pblk + b);
+      icount(ip, -(int)e[i].len);
+    } else {
+      bp = bread(ip->dev, e[i].pblk);
+      extfree(ip, (struct exthdr*)bp->data);
+      brelse(bp);
+      bfree(ip->dev, e[i].pblk);
+      icount(ip, -1);
+    }
+  }
+}
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, allocate it, and up to want-1
+// blocks after it, which are mapped but not zeroed: the file
+// can only grow by writing them.  data says how to zero the
+// block at bn (BDATA, BMETA or BKEEP).  *got is set to the
+// number of blocks allocated, 0 if bn already had one.
 // returns 0 if out of disk space.
 // 查找inode中第bn个块的实际块地址
 // 如果没有该块 就会分配一个
 // 如果磁盘空间不足 返回0
 static uint
-bmap(struct inode *ip, uint bn)
+bmapn(struct inode *ip, uint bn, int want, int data, int *got)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr;
+
+  *got = 0;
+  if(want > MAXFILE - bn)
+    want = MAXFILE - bn;
+  if(sb.flags & FS_EXTENTS)
+    return bmapext(ip, bn, want, data, got);
 // 判断是否是直接块
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-		// 申请一个块
-      addr = balloc(ip->dev);
-      if(addr == 0)
-        return 0;
-      ip->addrs[bn] = addr;
+		// 申请一个块 尽量紧跟在前一个块后面
+      addr = ballocn(ip->dev, bgoal(ip, bn > 0 ? ip->addrs[bn-1] : 0),
+                     data, min(want, NDIRECT - bn), got);
+      for(want = 0; addr && want < *got; want++)
+        ip->addrs[bn + want] = addr + want;
+      icount(ip, *got);
     }
     return addr;
   }
   bn -= NDIRECT;
 // 判断是否超过间接块大小
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    // 判断间接块是否为空
-    if((addr = ip->addrs[NDIRECT]) == 0){
-		// 申请一个块
-      addr = balloc(ip->dev);
-      if(addr == 0)
-        return 0;
-      ip->addrs[NDIRECT] = addr;
+  if(bn < NINDIRECT)
+    return bmapind(ip, &ip->addrs[NDIRECT], bn, 1, want, data, got);
+  bn -= NINDIRECT;
+  if(bn < NDINDIRECT)
+    return bmapind(ip, &ip->addrs[NDIRECT+1], bn, 2, want, data, got);
+  bn -= NDINDIRECT;
+  if(bn < NTINDIRECT)
+    return bmapind(ip, &ip->addrs[NDIRECT+2], bn, 3, want, data, got);
+
+  panic("bmap: out of range");
+}
+
+// Return the disk block address of the nth block in inode ip,
+// allocating it if there is none.  A file that grows is given
+// a preallocation window: the allocation takes ip->pawin blocks
+// at once, so that a file appended to a little at a time gets
+// contiguous blocks with one bitmap update per window, even if
+// other files are growing too.  The window doubles with each
+// allocation, up to PREALLOC blocks, so it stays small for small
+// files.  ip->paend remembers where the window ended, and
+// itrim() gives back the part of it the file did not grow into
+// when the last reference to the inode goes.
+// returns 0 if out of disk space.
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  uint addr;
+  int got;
+
+  if(ip->type != T_FILE)
+    return bmapn(ip, bn, 1, BMETA, &got);
+  if(ip->pawin < 1)
+    ip->pawin = 1;
+  addr = bmapn(ip, bn, ip->pawin, BDATA, &got);
+  if(got > 0)
+    ip->paend = bn + got;
+  if(got > 0 && ip->pawin < PREALLOC)
+    ip->pawin = min(ip->pawin * 2, PREALLOC);
+  return addr;
+}
+
+// Move the contents of inline file ip out to a data block, so
+// that it can grow past NINLINE bytes.  Returns 0, or -1 if out
+// of disk space.  Caller must hold ip->lock and be in a
+// transaction.
+static int
+iunline(struct inode *ip)
+{
+  char data[NINLINE];
+  struct buf *bp;
+  uint addr;
+
+  memmove(data, ip->data, sizeof(data));
+  memset(ip->data, 0, sizeof(ip->data));
+  ip->flags &= ~DI_INLINE;
+  if(ip->size > 0){
+    if((addr = bmap(ip, 0)) == 0){
+      memmove(ip->data, data, sizeof(data));
+      ip->flags |= DI_INLINE;
+      return -1;
     }
-	// 读取间接块
     bp = bread(ip->dev, addr);
-	// 转为uint数组
-    a = (uint*)bp->data;
-	// 如果间接块不存在
-    if((addr = a[bn]) == 0){
-		// 为间接块申请个空间
-      addr = balloc(ip->dev);
-      if(addr){
-        a[bn] = addr;
-        log_write(bp);
-      }
+    memset(bp->data, 0, BSIZE);
+    memmove(bp->data, data, ip->size);
+    log_data(bp);
+    brelse(bp);
+  }
+  iupdate(ip);
+  istatinc(nunline);
+  return 0;
+}
+
+// Allocate blocks for ip, without zeroing them, so that it has
+// blocks for at least its first n, as if it had been written to
+// that length; its size stays the same, so later writes that
+// extend the file use them.  Allocates at most one run of
+// blocks, little enough for one transaction.  Returns the
+// number of blocks from the start of the file now known to be
+// mapped, or -1 if the disk is full.  Caller must hold ip->lock
+// and be in a transaction.
+int
+iprealloc(struct inode *ip, uint n)
+{
+  uint bn;
+  int got;
+
+  if(n > MAXFILE)
+    n = MAXFILE;
+  if((ip->flags & DI_INLINE) && n > 0 && iunline(ip) < 0)
+    return -1;
+  bn = (ip->size + BSIZE - 1) / BSIZE;
+  // blocks asked for are kept, window or not.
+  if(n > bn)
+    ip->paend = 0;
+  for(; bn < n; bn++){
+    if(bmapn(ip, bn, n - bn, BKEEP, &got) == 0)
+      return -1;
+    if(got > 0){
+      iupdate(ip);
+      return bn + got;
     }
+  }
+  return bn;
+}
+
+// Free indirect block addr and everything below it,
+// level levels deep.
+static void
+itruncind(struct inode *ip, uint addr, int level)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(level > 1)
+      itruncind(ip, a[j], level-1);
+    else
+      bfree(ip->dev, a[j]);
+  }
+  brelse(bp);
+  bfree(ip->dev, addr);
+}
+
+// Unmap block bn of the tree under *root, level levels deep,
+// which must be the file's last mapped block, and return the
+// disk block it was; frees the indirect blocks that leaves empty.
+static uint
+bunmapind(struct inode *ip, uint *root, uint bn, int level)
+{
+  struct buf *bp;
+  uint *a, addr, span, i;
+
+  if(*root == 0)
+    return 0;
+  for(span = 1, i = 1; i < level; i++)
+    span *= NINDIRECT;
+  bp = bread(ip->dev, *root);
+  a = (uint*)bp->data;
+  i = bn / span;
+  if(level > 1){
+    addr = bunmapind(ip, &a[i], bn % span, level-1);
+  } else {
+    addr = a[i];
+    a[i] = 0;
+  }
+  // the first block below an indirect block is the last one
+  // it held; don't log an update of a block being freed.
+  if(bn == 0){
     brelse(bp);
+    bfree(ip->dev, *root);
+    icount(ip, -1);
+    *root = 0;
+  } else {
+    log_write(bp);
+    brelse(bp);
+  }
+  return addr;
+}
+
+// Unmap block bn of ip, which must be its last mapped block,
+// and return the disk block it was.
+static uint
+bunmap(struct inode *ip, uint bn)
+{
+  uint addr;
+
+  if(bn < NDIRECT){
+    addr = ip->addrs[bn];
+    ip->addrs[bn] = 0;
     return addr;
   }
+  bn -= NDIRECT;
+  if(bn < NINDIRECT)
+    return bunmapind(ip, &ip->addrs[NDIRECT], bn, 1);
+  bn -= NINDIRECT;
+  if(bn < NDINDIRECT)
+    return bunmapind(ip, &ip->addrs[NDIRECT+1], bn, 2);
+  bn -= NDINDIRECT;
+  return bunmapind(ip, &ip->addrs[NDIRECT+2], bn, 3);
+}
 
-  panic("bmap: out of range");
+// Unmap the blocks node h maps from file block nb on, which are
+// the last ones it maps, freeing them and the nodes left empty.
+static void
+exttrim(struct inode *ip, struct exthdr *h, uint nb)
+{
+  struct extent *e;
+  struct buf *bp;
+  uint b;
+
+  while(h->n > 0){
+    e = &EXTENTS(h)[h->n-1];
+    if(h->depth > 0){
+      bp = bread(ip->dev, e->pblk);
+      if(e->lblk < nb){
+        exttrim(ip, (struct exthdr*)bp->data, nb);
+        log_write(bp);
+        brelse(bp);
+        return;
+      }
+      extfree(ip, (struct exthdr*)bp->data);
+      brelse(bp);
+      bfree(ip->dev, e->pblk);
+      icount(ip, -1);
+      h->n--;
+      continue;
+    }
+    if(e->lblk + e->len <= nb)
+      return;
+    for(b = e->lblk < nb ? nb : e->lblk; b < e->lblk + e->len; b++){
+      bfree(ip->dev, e->pblk + (b - e->lblk));
+      icount(ip, -1);
+    }
+    if(e->lblk < nb){
+      e->len = nb - e->lblk;
+      return;
+    }
+    h->n--;
+  }
+}
+
+// Give back the blocks ip's last preallocation window mapped
+// past the end of the file, so that a file nobody has open
+// holds only the blocks its size needs.  Caller must hold
+// ip->lock and be in a transaction.
+static void
+itrim(struct inode *ip)
+{
+  uint nb, bn, addr;
+
+  nb = (ip->size + BSIZE - 1) / BSIZE;
+  if(ip->paend > nb && (ip->flags & DI_INLINE) == 0){
+    if(sb.flags & FS_EXTENTS){
+      exttrim(ip, EXTROOT(ip), nb);
+      if(EXTROOT(ip)->n == 0)
+        EXTROOT(ip)->depth = 0;
+      ip->ecache.len = 0;
+    } else {
+      for(bn = ip->paend; bn-- > nb; )
+        if((addr = bunmap(ip, bn)) != 0){
+          bfree(ip->dev, addr);
+          icount(ip, -1);
+        }
+    }
+    iupdate(ip);
+  }
+  ip->paend = 0;
 }
 
 // Truncate inode (discard contents).
@@ -467,9 +1445,29 @@ bmap(struct inode *ip, uint bn)
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
+
+  ip->pawin = 1;
+  ip->paend = 0;
+  if(ip->flags & DI_INLINE){
+    memset(ip->data, 0, sizeof(ip->data));
+    ip->size = 0;
+    ip->nblocks = 0;
+    iupdate(ip);
+    return;
+  }
+  // an emptied file starts out inline again.
+  if(ip->type == T_FILE && (sb.flags & FS_INLINE))
+    ip->flags |= DI_INLINE;
+  if(sb.flags & FS_EXTENTS){
+    extfree(ip, EXTROOT(ip));
+    memset(ip->data, 0, sizeof(ip->data));
+    ip->ecache.len = 0;
+    ip->size = 0;
+    ip->nblocks = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
   	// 释放该文件对应的所有块 然后将块设置为0
@@ -478,25 +1476,87 @@ itrunc(struct inode *ip)
       ip->addrs[i] = 0;
     }
   }
- // 看来最后一个块有特殊用途
- // 看起来像是附加块 用来记录用到了哪些块
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+ // 后面三个块分别是一级、二级、三级间接块
+ // 用来记录用到了哪些块
+  for(i = 0; i < 3; i++){
+    if(ip->addrs[NDIRECT+i]){
+      itruncind(ip, ip->addrs[NDIRECT+i], i+1);
+      ip->addrs[NDIRECT+i] = 0;
     }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
   }
 
   ip->size = 0;
+  ip->nblocks = 0;
   iupdate(ip);
 }
 
+// Count the blocks indirect block addr holds, itself included,
+// level levels deep.
+static uint
+iblocksind(struct inode *ip, uint addr, int level)
+{
+  struct buf *bp;
+  uint *a, n;
+  int j;
+
+  n = 1;
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    n += level > 1 ? iblocksind(ip, a[j], level-1) : 1;
+  }
+  brelse(bp);
+  return n;
+}
+
+// Count the blocks node h maps, and the nodes below it.
+static uint
+extblocks(struct inode *ip, struct exthdr *h)
+{
+  struct extent *e = EXTENTS(h);
+  struct buf *bp;
+  uint n;
+  int i;
+
+  n = 0;
+  for(i = 0; i < h->n; i++){
+    if(h->depth == 0){
+      n += e[i].len;
+    } else {
+      bp = bread(ip->dev, e[i].pblk);
+      n += 1 + extblocks(ip, (struct exthdr*)bp->data);
+      brelse(bp);
+    }
+  }
+  return n;
+}
+
+// The disk blocks ip holds: data blocks, those preallocated
+// past the end included, and the blocks that map them.  Walks
+// the whole mapping, so stati() does it once per inode and then
+// keeps ip->nblocks up to date as blocks come and go.
+static uint
+iblocks(struct inode *ip)
+{
+  uint n;
+  int i;
+
+  if(ip->flags & DI_INLINE)
+    return 0;
+  if(sb.flags & FS_EXTENTS)
+    return extblocks(ip, EXTROOT(ip));
+  n = 0;
+  for(i = 0; i < NDIRECT; i++)
+    if(ip->addrs[i])
+      n++;
+  for(i = 0; i < 3; i++)
+    if(ip->addrs[NDIRECT+i])
+      n += iblocksind(ip, ip->addrs[NDIRECT+i], i+1);
+  return n;
+}
+
 // Copy stat information from inode.
 // Caller must hold ip->lock.
 void
@@ -507,6 +1567,71 @@ stati(struct inode *ip, struct stat *st)
   st->type = ip->type;
   st->nlink = ip->nlink;
   st->size = ip->size;
+  if(ip->nblocks < 0)
+    ip->nblocks = iblocks(ip);
+  st->blocks = ip->nblocks;
+}
+
+// Readahead window in blocks; 0 turns readahead off.
+static int rawindow = RAWINDOW;
+
+// Set the readahead window, returning the old one.
+int
+setrawindow(int n)
+{
+  int old = rawindow;
+
+  if(n < 0)
+    n = 0;
+  if(n > MAXRAWINDOW)
+    n = MAXRAWINDOW;
+  rawindow = n;
+  return old;
+}
+
+// Called by readi() before it reads block bn of ip.
+// If ip is being read sequentially, start reading the
+// next rawindow blocks so that they arrive while the
+// caller is busy with bn. A new batch is started once
+// the reader gets within half a window of the last
+// block already requested.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint b, end, last, addrs[MAXRAWINDOW];
+  int i, n, win = rawindow;
+
+  // the same block again (small reads), or the next one?
+  if(bn != ip->ranext && bn + 1 != ip->ranext){
+    ip->ranext = bn + 1;
+    ip->raend = bn;
+    return;
+  }
+  ip->ranext = bn + 1;
+  if(win == 0 || ip->size == 0)
+    return;
+
+  last = (ip->size - 1) / BSIZE;
+  if(ip->raend > bn + win/2 || ip->raend >= last)
+    return;
+  end = min(bn + win, last);
+  // map the blocks first, since bmap may have to read an
+  // indirect block, and that would push out the queued reads
+  // before they can be merged.
+  n = 0;
+  for(b = (ip->raend > bn ? ip->raend : bn) + 1; b <= end; b++){
+    // every block below ip->size is mapped, so bmap
+    // will not allocate.
+    if((addrs[n] = bmap(ip, b)) == 0)
+      break;
+    n++;
+  }
+  bplug();
+  for(i = 0; i < n; i++)
+    breadahead(ip->dev, addrs[i]);
+  bunplug();
+  ip->raend = end;
 }
 
 // Read data from inode.
@@ -528,8 +1653,14 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   // 限制读取大小
   if(off + n > ip->size)
     n = ip->size - off;
+  if(ip->flags & DI_INLINE){
+    if(either_copyout(user_dst, dst, ip->data + off, n) == -1)
+      return -1;
+    return n;
+  }
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    readahead(ip, off/BSIZE);
   	// 获取该块的实际地址
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
@@ -566,8 +1697,22 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off > ip->size || off + n < off)
     return -1;
   // 不能超过最大大小（直接块数量+间接块数量）*一块大小
-  if(off + n > MAXFILE*BSIZE)
+  if((uint64)off + n > (uint64)MAXFILE*BSIZE)
     return -1;
+  // an inline file's data goes to disk with its inode, in
+  // the log, until it outgrows the dinode.
+  if(ip->flags & DI_INLINE){
+    if(off + n <= NINLINE){
+      if(either_copyin(ip->data + off, user_src, src, n) == -1)
+        return -1;
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    if(iunline(ip) < 0)
+      return -1;
+  }
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ip, off/BSIZE);
@@ -579,7 +1724,10 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       brelse(bp);
       break;
     }
-    log_write(bp);
+    if(ip->type == T_FILE)
+      log_data(bp);  // file data may bypass the log
+    else
+      log_write(bp);
     brelse(bp);
   }
 // 如果超过原来大小了
@@ -603,40 +1751,546 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Read block bn of directory dp, which must exist.
+static struct buf*
+dirblock(struct inode *dp, uint bn)
+{
+  uint addr;
+
+  if((addr = bmap(dp, bn)) == 0)
+    panic("dirblock");
+  return bread(dp->dev, addr);
+}
+
+// Add a block to the end of directory dp.
+// Returns its block number, or -1 if out of disk space.
+static int
+diraddblock(struct inode *dp)
+{
+  uint bn = dp->size / BSIZE;
+
+  if(bmap(dp, bn) == 0)
+    return -1;
+  dp->size += BSIZE;
+  iupdate(dp);
+  return bn;
+}
+
+// The length of name, which holds at most DIRSIZ bytes
+// and is NUL-terminated if shorter.
+static int
+namelen(char *name)
+{
+  int n;
+
+  for(n = 0; n < DIRSIZ && name[n]; n++)
+    ;
+  return n;
+}
+
+// The record at byte off of directory block data blk.
+static struct dirent*
+direc(void *blk, uint off)
+{
+  struct dirent *de = (struct dirent*)((char*)blk + off);
+
+  if(de->reclen < DIRHDR || off + de->reclen > BSIZE)
+    panic("direc: bad record");
+  return de;
+}
+
+// Look for name, len bytes long, in buf b, the directory's
+// block bn.  Returns the inode number, or 0, and sets *poff.
+// Records are compared by length before their names, and the
+// rest of a record is skipped by its reclen.
+static uint
+dirscan(struct buf *b, uint bn, char *name, int len, uint *poff)
+{
+  struct dirent *de;
+  uint off;
+
+  for(off = 0; off < BSIZE; off += de->reclen){
+    de = direc(b->data, off);
+    if(de->inum != 0 && de->namelen == len && memcmp(de->name, name, len) == 0){
+      if(poff)
+        *poff = bn * BSIZE + off;
+      return de->inum;
+    }
+  }
+  return 0;
+}
+
+// The hash that places a name of len bytes in an indexed
+// directory (FNV-1a).
+static uint
+dxhash(char *name, int len)
+{
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < len; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// The header of index block bn, held in buf b.
+static struct dxhead*
+dxhead(struct buf *b, uint bn)
+{
+  return (struct dxhead*)(b->data + (bn == 0 ? DXROOT : 0));
+}
+
+static struct dxentry*
+dxentries(struct buf *b, uint bn)
+{
+  return (struct dxentry*)(dxhead(b, bn) + 1);
+}
+
+// Is dp an indexed directory?  Its block 0 is in b.
+static int
+dxisroot(struct inode *dp, struct buf *b)
+{
+  struct dxhead *h = dxhead(b, 0);
+
+  return dp->size >= 2*BSIZE && direc(b->data, 0)->reclen == DIRREC(1) &&
+    direc(b->data, DIRREC(1))->reclen == DIRREC(2) &&
+    h->zero == 0 && h->namelen == 0 &&
+    memcmp(h->magic, DXMAGIC, sizeof(DXMAGIC)) == 0;
+}
+
+// The path from the root of an index to a leaf.
+struct dxpath {
+  int levels;
+  uint node[2];     // index blocks: the root (0) and maybe one below
+  int at[2];        // entry followed in each
+  uint leaf;        // the leaf's block number
+};
+
+// Find the leaf of indexed directory dp whose range holds hash,
+// recording the way there in *p.  root holds block 0.
+static void
+dxfind(struct inode *dp, struct buf *root, uint hash, struct dxpath *p)
+{
+  struct buf *b = root;
+  struct dxentry *e;
+  uint bn = 0;
+  int lo, hi, mid, l;
+
+  p->levels = dxhead(root, 0)->levels;
+  for(l = 0; l < p->levels; l++){
+    e = dxentries(b, bn);
+    // the last entry whose hash is <= hash; e[0].hash is 0.
+    lo = 0;
+    hi = dxhead(b, bn)->count - 1;
+    while(lo < hi){
+      mid = (lo + hi + 1) / 2;
+      if(e[mid].hash <= hash)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    p->node[l] = bn;
+    p->at[l] = lo;
+    bn = e[lo].block;
+    if(b != root)
+      brelse(b);
+    if(l + 1 < p->levels)
+      b = dirblock(dp, bn);
+  }
+  p->leaf = bn;
+}
+
+// Search directory dp for name.  Returns its inode number,
+// or 0, and sets *poff to the byte offset of the entry.
+static uint
+dirsearch(struct inode *dp, char *name, uint *poff)
+{
+  uint bn, nb, inum;
+  struct buf *b;
+  struct dxpath p;
+  int len = namelen(name);
+
+  if(dp->size == 0)
+    return 0;
+
+  // "." and ".." are always the first two entries of block 0.
+  b = dirblock(dp, 0);
+  if(dxisroot(dp, b)){
+    inum = 0;
+    if(name[0] == '.')
+      inum = dirscan(b, 0, name, len, poff);
+    if(inum == 0){
+      dxfind(dp, b, dxhash(name, len), &p);
+      brelse(b);
+      b = dirblock(dp, p.leaf);
+      inum = dirscan(b, p.leaf, name, len, poff);
+    }
+    brelse(b);
+    return inum;
+  }
+  brelse(b);
+
+  // a plain directory: look at every entry, a block at a time.
+  nb = dp->size / BSIZE;
+  for(bn = 0; bn < nb; bn++){
+    b = dirblock(dp, bn);
+    inum = dirscan(b, bn, name, len, poff);
+    brelse(b);
+    if(inum)
+      return inum;
+  }
+  return 0;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Callers that don't need the offset get the answer from the
+// directory entry cache if it is there.
 //如果找到了 返回一个指向相应未上锁的inode
 // poff被设置为这个dir在dp里面的偏移量
 // dp看起来是存储着所有目录的信息
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint inum;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
-// 读取dp
-  for(off = 0; off < dp->size; off += sizeof(de)){
-  	// 从dp中读取大小为de的内容放到de里面
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-	// 这个dir没有被使用
-    if(de.inum == 0)
-      continue;
-	// 比较字符串匹配
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      // 设置偏移量
-      if(poff)
-        *poff = off;
-	  // 获取inode的num
-      inum = de.inum;
-	  // 返回该目录对应的inode
-      return iget(dp->dev, inum);
+  if(poff == 0 && dclookup(dp->dev, dp->inum, name, &inum))
+    return inum ? iget(dp->dev, inum) : 0;
+  inum = dirsearch(dp, name, poff);
+  dcenter(dp->dev, dp->inum, name, inum);
+  return inum ? iget(dp->dev, inum) : 0;
+}
+
+// Put (name, inum), name being len bytes, in buf b: in a free
+// record big enough, or in the slack after a record's name,
+// which is split off into a record of its own.  Returns the
+// record's offset in the block, or -1 if there is no room.
+static int
+dirput(struct buf *b, char *name, int len, uint inum)
+{
+  struct dirent *de, *nd;
+  uint off, used;
+
+  for(off = 0; off < BSIZE; off += de->reclen){
+    de = direc(b->data, off);
+    used = de->inum ? DIRREC(de->namelen) : 0;
+    if(de->reclen - used >= DIRREC(len)){
+      if(used){
+        nd = (struct dirent*)((char*)de + used);
+        nd->reclen = de->reclen - used;
+        de->reclen = used;
+        de = nd;
+        off += used;
+      }
+      // 复制名字 设置inode number
+      de->inum = inum;
+      de->namelen = len;
+      de->unused = 0;
+      memmove(de->name, name, len);
+      log_write(b);
+      return off;
     }
   }
+  return -1;
+}
 
+// Insert index entry (hash, block) at position at of index
+// block bn, held in b, which must have room.
+static void
+dxinsertat(struct buf *b, uint bn, int at, uint hash, uint block)
+{
+  struct dxhead *h = dxhead(b, bn);
+  struct dxentry *e = dxentries(b, bn);
+
+  memmove(&e[at+1], &e[at], (h->count - at) * sizeof(*e));
+  e[at].hash = hash;
+  e[at].block = block;
+  h->count++;
+  log_write(b);
+}
+
+// A dirent and its name's hash, for repacking a leaf.
+struct dxsort {
+  uint hash;
+  struct dirent *de;
+};
+
+// Add de to v[0..*n), which is kept sorted by hash.
+static void
+dxsortadd(struct dxsort *v, int *n, struct dirent *de)
+{
+  struct dxsort t;
+  int j;
+
+  v[*n].de = de;
+  v[*n].hash = dxhash(de->name, de->namelen);
+  for(j = (*n)++; j > 0 && v[j-1].hash > v[j].hash; j--){
+    t = v[j];
+    v[j] = v[j-1];
+    v[j-1] = t;
+  }
+}
+
+// Fill buf b with copies of the n records in v, packed one
+// after another; the last one's reclen runs to the end of the
+// block.  The records must not be in b.
+static void
+dirpack(struct buf *b, struct dxsort *v, int n)
+{
+  struct dirent *de = (struct dirent*)b->data;
+  uint off = 0;
+  int i;
+
+  memset(b->data, 0, BSIZE);
+  for(i = 0; i < n; i++){
+    de = (struct dirent*)(b->data + off);
+    memmove(de, v[i].de, DIRHDR + v[i].de->namelen);
+    de->reclen = DIRREC(de->namelen);
+    off += de->reclen;
+  }
+  de->reclen += BSIZE - off;
+  log_write(b);
+}
+
+// Turn directory dp, one full block held in b0, into an indexed
+// directory with a single leaf holding all but "." and "..".
+// Returns 0, or -1 if out of memory or disk space.
+static int
+dxconvert(struct inode *dp, struct buf *b0)
+{
+  struct buf *lb;
+  struct dxhead *h;
+  struct dxsort *v;
+  struct dirent *de;
+  uint off;
+  int bn, n;
+
+  if((v = (struct dxsort*)kalloc()) == 0)
+    return -1;
+  if((bn = diraddblock(dp)) < 0){
+    kfree((char*)v);
+    return -1;
+  }
+  n = 0;
+  de = direc(b0->data, DIRREC(1));
+  for(off = DIRREC(1) + de->reclen; off < BSIZE; off += de->reclen){
+    de = direc(b0->data, off);
+    if(de->inum != 0){
+      v[n].de = de;
+      n++;
+    }
+  }
+  lb = dirblock(dp, bn);
+  dirpack(lb, v, n);
+  brelse(lb);
+  kfree((char*)v);
+
+  // ".." gives up its slack to a free record holding the root.
+  direc(b0->data, DIRREC(1))->reclen = DIRREC(2);
+  h = dxhead(b0, 0);
+  memset(h, 0, BSIZE - DXROOT);
+  h->reclen = BSIZE - DXROOT;
+  memmove(h->magic, DXMAGIC, sizeof(DXMAGIC));
+  h->levels = 1;
+  dxinsertat(b0, 0, 0, 0, bn);
+  return 0;
+}
+
+// Add (name, inum) to indexed directory dp, whose block 0 is in
+// b0.  A leaf without room for the record is packed again if
+// that frees enough space, or else split in two at a hash
+// boundary near the middle, and the new leaf is added to the
+// index; a full root index moves down into an index block, and
+// a full index block splits.  Returns 0, or -1 if out of memory
+// or disk space or if the index or the leaf cannot be split.
+static int
+dxlink(struct inode *dp, struct buf *b0, char *name, uint inum)
+{
+  struct dxpath p;
+  struct buf *lb, *nb, *xb, *yb;
+  struct dxsort *v;
+  struct dirent *de, *nd;
+  struct dxhead *h;
+  char *pg;
+  uint hash, xn, off, total, left;
+  int i, j, n, mid, nl, ni, full, r, len;
+
+  len = namelen(name);
+  hash = dxhash(name, len);
+  dxfind(dp, b0, hash, &p);
+  lb = dirblock(dp, p.leaf);
+  if(dirput(lb, name, len, inum) >= 0){
+    brelse(lb);
+    return 0;
+  }
+
+  // sort a copy of the leaf's records, and the new one, by hash.
+  if((pg = kalloc()) == 0){
+    brelse(lb);
+    return -1;
+  }
+  memmove(pg, lb->data, BSIZE);
+  nd = (struct dirent*)(pg + BSIZE);
+  nd->inum = inum;
+  nd->namelen = len;
+  nd->unused = 0;
+  memmove(nd->name, name, len);
+  v = (struct dxsort*)(pg + BSIZE + DIRREC(DIRSIZ));
+  n = 0;
+  total = 0;
+  for(off = 0; off < BSIZE; off += de->reclen){
+    de = direc(pg, off);
+    if(de->inum != 0){
+      dxsortadd(v, &n, de);
+      total += DIRREC(de->namelen);
+    }
+  }
+  dxsortadd(v, &n, nd);
+  total += DIRREC(len);
+
+  // the leaf's free space was only scattered: pack it.
+  r = -1;
+  xb = b0;
+  if(total <= BSIZE){
+    dirpack(lb, v, n);
+    r = 0;
+    goto out;
+  }
+
+  // split near the middle by bytes; names with the same hash
+  // must stay in one leaf.
+  left = 0;
+  for(mid = 0; mid < n-1 && (mid == 0 || left + DIRREC(v[mid].de->namelen) <= total/2); mid++)
+    left += DIRREC(v[mid].de->namelen);
+  for(; mid < n && v[mid-1].hash == v[mid].hash; mid++)
+    left += DIRREC(v[mid].de->namelen);
+  if(mid == n)
+    for(; mid > 0 && v[mid-1].hash == v[mid].hash; mid--)
+      left -= DIRREC(v[mid-1].de->namelen);
+
+  // check that the index has room, then get the new blocks.
+  xn = p.node[p.levels-1];
+  xb = (xn == 0) ? b0 : dirblock(dp, xn);
+  full = dxhead(xb, xn)->count == (xn == 0 ? DXROOTMAX : DXNODEMAX);
+  if(mid == 0 || mid == n || left > BSIZE || total - left > BSIZE)
+    goto out;
+  if(full && p.levels == 2 && dxhead(b0, 0)->count == DXROOTMAX)
+    goto out;
+  if((nl = diraddblock(dp)) < 0)
+    goto out;
+  ni = 0;
+  if(full && (ni = diraddblock(dp)) < 0){
+    // nl is already part of dp, zeroed: leave it one free
+    // record, which scans skip, since it won't be a leaf.
+    nb = dirblock(dp, nl);
+    dirpack(nb, v, 0);
+    brelse(nb);
+    goto out;
+  }
+
+  // split the leaf.
+  nb = dirblock(dp, nl);
+  dirpack(lb, v, mid);
+  dirpack(nb, v + mid, n - mid);
+  brelse(nb);
+
+  // add (v[mid].hash, nl) to the index after the old leaf.
+  i = p.at[p.levels-1] + 1;
+  if(!full){
+    dxinsertat(xb, xn, i, v[mid].hash, nl);
+  } else if(p.levels == 1){
+    // the root is full: move its entries into index block ni.
+    yb = dirblock(dp, ni);
+    h = dxhead(yb, ni);
+    memmove(h, dxhead(b0, 0),
+            sizeof(struct dxhead) + DXROOTMAX * sizeof(struct dxentry));
+    h->reclen = BSIZE;
+    h->levels = 0;
+    dxinsertat(yb, ni, i, v[mid].hash, nl);
+    brelse(yb);
+    dxhead(b0, 0)->levels = 2;
+    dxhead(b0, 0)->count = 0;
+    dxinsertat(b0, 0, 0, 0, ni);
+  } else {
+    // index block xn is full: move its upper half into ni.
+    yb = dirblock(dp, ni);
+    j = DXNODEMAX / 2;
+    h = dxhead(yb, ni);
+    memset(h, 0, sizeof(*h));
+    h->reclen = BSIZE;
+    h->count = DXNODEMAX - j;
+    memmove(dxentries(yb, ni), dxentries(xb, xn) + j,
+            (DXNODEMAX - j) * sizeof(struct dxentry));
+    dxhead(xb, xn)->count = j;
+    log_write(xb);
+    log_write(yb);
+    if(i <= j)
+      dxinsertat(xb, xn, i, v[mid].hash, nl);
+    else
+      dxinsertat(yb, ni, i - j, v[mid].hash, nl);
+    dxinsertat(b0, 0, p.at[0] + 1, dxentries(yb, ni)[0].hash, ni);
+    brelse(yb);
+  }
+  r = 0;
+
+out:
+  if(xb != b0)
+    brelse(xb);
+  brelse(lb);
+  kfree(pg);
+  return r;
+}
+
+// Add (name, inum) to directory dp, which does not hold name.
+static int
+dirinsert(struct inode *dp, char *name, uint inum)
+{
+  struct buf *b;
+  uint bn, nb;
+  int r, bn1, len = namelen(name);
+
+  if(dp->size > 0){
+    b = dirblock(dp, 0);
+    if(dxisroot(dp, b)){
+      r = dxlink(dp, b, name, inum);
+      brelse(b);
+      return r;
+    }
+    brelse(b);
+  }
+
+  // Look for room for the record, a block at a time.
+  nb = dp->size / BSIZE;
+  for(bn = 0; bn < nb; bn++){
+    b = dirblock(dp, bn);
+    r = dirput(b, name, len, inum);
+    brelse(b);
+    if(r >= 0)
+      return 0;
+  }
+
+  // a full one-block directory becomes indexed.
+  if(dp->size == BSIZE){
+    b = dirblock(dp, 0);
+    r = dxconvert(dp, b);
+    if(r == 0)
+      r = dxlink(dp, b, name, inum);
+    brelse(b);
+    return r;
+  }
+
+  // 写在末尾: a new block, one free record to start with.
+  if((bn1 = diraddblock(dp)) < 0)
+    return -1;
+  b = dirblock(dp, bn1);
+  memset(b->data, 0, BSIZE);
+  ((struct dirent*)b->data)->reclen = BSIZE;
+  dirput(b, name, len, inum);
+  brelse(b);
   return 0;
 }
 
@@ -647,9 +2301,8 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
-  struct dirent de;
   struct inode *ip;
+  int r;
 
   // Check that name is not present.
   // 这个名字已经存在
@@ -659,23 +2312,92 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-	// 找到一个没有被使用的！
-    if(de.inum == 0)
-      break;
-  }
-	// 复制名字
-  strncpy(de.name, name, DIRSIZ);
-  // 设置inode number
-  de.inum = inum;
-  // 写进去
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    return -1;
+  r = dirinsert(dp, name, inum);
+  if(r == 0)
+    dcenter(dp->dev, dp->inum, name, inum);
+  return r;
+}
 
-  return 0;
+// Remove the directory entry at byte offset off of dp, as found
+// by dirlookup().  Its space joins the record before it in the
+// block, if there is one, so that freed space stays in pieces
+// big enough to reuse.
+void
+dirunlink(struct inode *dp, uint off)
+{
+  struct buf *b;
+  struct dirent *de, *prev;
+  uint o;
+
+  b = dirblock(dp, off / BSIZE);
+  prev = 0;
+  for(o = 0; o < off % BSIZE; o += de->reclen)
+    prev = de = direc(b->data, o);
+  de = direc(b->data, off % BSIZE);
+  if(o != off % BSIZE || de->inum == 0)
+    panic("dirunlink");
+  if(prev)
+    prev->reclen += de->reclen;
+  else
+    de->inum = 0;
+  log_write(b);
+  brelse(b);
+}
+
+// Copy records describing the entries of directory dp, from
+// byte offset *off on, as struct dents to user address dst,
+// at most n bytes of them, and advance *off past the entries
+// copied.  An entry's type and size come from its dinode in
+// the buffer cache, which iupdate() keeps current, so the
+// entries' inodes need not be locked.  Returns the number of
+// bytes copied, 0 at the end of the directory, or -1 if the
+// next record does not fit in n bytes.
+// Caller must hold dp->lock.
+int
+dirread(struct inode *dp, uint *off, uint64 dst, int n)
+{
+  char rec[DENTREC(DIRSIZ)];
+  struct dent *d = (struct dent*)rec;
+  struct buf *b, *ib;
+  struct dirent *de;
+  struct dinode *dip;
+  uint bn, o, len;
+  int tot = 0;
+
+  while(*off < dp->size){
+    bn = *off / BSIZE;
+    b = dirblock(dp, bn);
+    // find the first record at or after *off.
+    for(o = 0; o < *off % BSIZE; o += direc(b->data, o)->reclen)
+      ;
+    for(; o < BSIZE; o += de->reclen){
+      de = direc(b->data, o);
+      if(de->inum != 0){
+        len = DENTREC(de->namelen);
+        if(tot + len > n){
+          brelse(b);
+          return tot > 0 ? tot : -1;
+        }
+        ib = bread(dp->dev, IBLOCK(de->inum, sb));
+        dip = (struct dinode*)ib->data + de->inum%IPB;
+        memset(rec, 0, len);
+        d->size = dip->size;
+        d->type = dip->type;
+        brelse(ib);
+        d->ino = de->inum;
+        d->reclen = len;
+        memmove(d->name, de->name, de->namelen);
+        if(either_copyout(1, dst + tot, rec, len) == -1){
+          brelse(b);
+          return -1;
+        }
+        tot += len;
+      }
+      *off = bn * BSIZE + o + de->reclen;
+    }
+    brelse(b);
+  }
+  return tot;
 }
 
 // Paths
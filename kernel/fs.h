@@ -20,13 +20,21 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint flags;        // FS_* flags
 };
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define FS_ORDERED 0x1  // journal only metadata; file data is written in place
+#define FS_EXTENTS 0x2  // files and directories map their blocks with extents
+#define FS_INLINE  0x4  // files of up to NINLINE bytes keep their data in the dinode
+
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NDINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
+#define NINLINE 112  // bytes of data a dinode can hold
 
 // On-disk inode structure
 struct dinode {
@@ -35,9 +43,43 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint flags;           // DI_* flags
+  union {
+    uint addrs[NDIRECT+3];   // Data block addresses; then single,
+                             // double and triple indirect blocks
+    char data[NINLINE];      // DI_INLINE: the file's contents
+  };
+};
+
+// On a file system with FS_INLINE, a new file starts out with
+// DI_INLINE set and its contents in data[], which costs no
+// block and no read beyond the inode's own.  A file that grows
+// past NINLINE bytes moves its contents to a block and clears
+// DI_INLINE; truncating it to 0 sets DI_INLINE again.
+#define DI_INLINE 0x1
+
+// On a file system with FS_EXTENTS, a file's addrs[] hold the
+// root of a tree of extents instead: a header, then entries.
+// The leaves' entries are extents, runs of len blocks starting
+// at file block lblk and disk block pblk. Above the leaves, an
+// entry's pblk is a disk block holding a node (a header and
+// entries) for the file blocks from lblk on.
+struct exthdr {
+  ushort n;       // entries in use
+  ushort depth;   // 0 for a leaf
 };
 
+struct extent {
+  uint lblk;      // first file block
+  uint pblk;      // first disk block, or the child node
+  uint len;       // number of blocks (leaves only)
+};
+
+// Entries in the root in addrs[], and in a node block.
+#define NIEXTENT ((sizeof(uint)*(NDIRECT+3) - sizeof(struct exthdr)) / sizeof(struct extent))
+#define NBEXTENT ((BSIZE - sizeof(struct exthdr)) / sizeof(struct extent))
+#define EXTMAXDEPTH 4
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -50,12 +92,55 @@ struct dinode {
 // Block of free map containing bit for block b
 #define BBLOCK(b, sb) ((b)/BPB + sb.bmapstart)
 
-// Directory is a file containing a sequence of dirent structures.
-#define DIRSIZ 14
+// Directory is a file containing a sequence of variable-length
+// records, dirents holding only as much name as they need.  A
+// record never crosses a block boundary: each block is covered
+// exactly by its records, and a record's reclen is the distance
+// to the next.  A record with inum 0 is free space; so is any
+// slack after a record's name, which a new record can take over.
+// A directory's size is always a whole number of blocks.
+#define DIRSIZ 255
 
 struct dirent {
 // 为0代表该目录项空闲
-  ushort inum;
+  uint inum;
+  ushort reclen;          // bytes from this record to the next
+  uchar namelen;          // bytes of name, which is not NUL-terminated
+  uchar unused;
   char name[DIRSIZ];
 };
 
+#define DIRHDR 8  // bytes of a dirent before the name
+// bytes a record for a name of len bytes needs
+#define DIRREC(len) ((DIRHDR + (len) + 3) & ~3)
+
+// A directory that outgrows one block is indexed by name hash,
+// like ext3's htree.  Block 0 keeps "." and ".." and then a free
+// record holding the root of the index; every other block is
+// either a leaf, an ordinary block of dirents whose names hash
+// into one range, or, in a two-level index, an index block,
+// which is a single free record.  Code that reads a directory
+// as plain records skips the index as free space.  Directories
+// of one block, and any made by mkfs, are searched linearly.
+#define DXMAGIC  "htree"
+#define DXROOT   (DIRREC(1) + DIRREC(2))  // offset of the root in block 0
+
+struct dxhead {
+  uint zero;              // inum: always 0
+  ushort reclen;          // to the end of the block
+  uchar namelen;          // always 0
+  uchar unused;
+  char magic[6];          // DXMAGIC
+  ushort levels;          // root: 1 if entries point at leaves, 2 at index blocks
+  ushort count;           // entries in use
+  ushort unused2;
+};
+
+struct dxentry {
+  uint hash;              // lowest name hash below; 0 for the first entry
+  uint block;             // directory block number of the child
+};
+
+// entries in the root and in an index block
+#define DXROOTMAX ((BSIZE - DXROOT - sizeof(struct dxhead)) / sizeof(struct dxentry))
+#define DXNODEMAX ((BSIZE - sizeof(struct dxhead)) / sizeof(struct dxentry))
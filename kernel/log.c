@@ -6,6 +6,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "stat.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -18,137 +20,564 @@
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// But if the blocks it reserves (MAXOPBLOCKS, or what it asks
+// for with begin_opn()) might not fit in the log, it
+// sleeps until the current transaction has been handed
+// to the commit thread. The log's size comes from the
+// superblock, so mkfs -l chooses it.
+//
+// Commits are done by a kernel thread, logcommitter(), not by
+// the last end_op(). A transaction stays open, gathering the
+// updates of many system calls, until it has been open for
+// COMMITTICKS ticks, is half full, or someone calls log_force()
+// (fsync). The thread then freezes the transaction by copying
+// its blocks into shadow buffers and lets new system calls
+// start at once into the next transaction, while it writes
+// the frozen copies to disk. So end_op() never waits for the
+// disk, and a system call's updates are durable only once its
+// transaction commits; callers that need that use fsync.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
-// Log appends are synchronous.
+//   log super block: where recovery starts
+//   a ring of transactions, each:
+//     header block, containing a sequence number, block #s for
+//       block A, B, C, ... and a checksum of those and of the
+//       blocks' contents
+//     block A
+//     block B
+//     block C
+//     ...
+// Recovery replays transactions with consecutive sequence
+// numbers and good checksums, starting with the one the log
+// super block names.
+//
+// A committed block is not installed at once. Its frozen copy
+// waits in memory, with the cached block pinned and dirty,
+// until a flusher thread checkpoints the log: every FLUSHTICKS
+// ticks, or when the ring fills, it writes the copies home and
+// advances the log super block past transactions that have
+// nothing left to install. A block that commits again before
+// then, like a bitmap or inode block, replaces its older copy
+// and is written home only once.
+//
+// If the superblock has FS_ORDERED set, file data blocks that
+// writei() passes to log_data() bypass the log: the commit
+// thread writes them to their home locations before it writes
+// the transaction that points to them, so they are written once
+// and a crash never exposes stale blocks through new metadata.
+// Nor is a block that a transaction frees allocated again
+// before that transaction has committed: written in place as
+// file data first, it would overwrite what the last committed
+// metadata, an old indirect or directory block say, still
+// points to, if the system crashed before the free committed.
+// So the blocks freed by the open transaction and by the one
+// being committed are kept out of the allocator's reach.
+//
+// A commit writes the header and all its log blocks at once,
+// in any order, and waits for them together. A crash part way
+// through leaves a header whose checksum does not match, and
+// recovery stops there. So a commit costs one disk round trip
+// however many blocks it holds.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
+  uint sum;   // checksum of seq, n, block[] and the logged blocks
+  uint64 seq; // transaction sequence number
   int block[LOGSIZE];
 };
 
+// Contents of the first log block.
+struct logsuper {
+  uint64 seq;   // first transaction recovery should replay
+  int pos;      // ring slot of its header, unless it wrapped to 0
+};
+
+// A committed transaction still in the ring.
+struct logtx {
+  uint64 seq;
+  int pos;      // ring slot of its header
+  int len;      // ring slots it uses, including any skipped at the end
+  int nowned;   // its blocks not yet home nor logged again since
+};
+
+// A committed block's contents, as of the last transaction
+// that logged it.
+enum { CK_FREE, CK_DIRTY, CK_HOME };
+struct logcopy {
+  int state;    // CK_DIRTY: not home yet; CK_HOME: home, but
+                // recovery might still replay its transaction
+  uint64 seq;   // that transaction
+  struct buf b;
+};
+
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // data blocks in the log, from the superblock
   // 记录多少个系统调用
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // log blocks those calls have reserved.
+  int freezing;    // commit thread is copying lh's blocks; please wait.
+  int wantcommit;  // commit lh as soon as outstanding reaches 0.
   int dev;
-  struct logheader lh;
+  int ordered;     // file data bypasses the log (FS_ORDERED)
+  struct logheader lh;  // the open transaction
+  int nord;        // file data blocks of the open transaction
+  int ord[LOGSIZE];
+  // blocks freed by the open transaction and by the one being
+  // committed, freed[txid%2] and the other (ordered mode).
+  int nfreed[2];
+  uchar freed[2][MAXFSSIZE/8];
+  uint opened;     // ticks when lh got its first block
+  uint64 txid;     // id of the open transaction
+  uint64 durable;  // id of the last transaction committed to disk
+
+  // the transaction being committed, and frozen copies of
+  // its blocks. only the commit thread uses these.
+  struct logheader clh;
+  struct buf shadow[LOGSIZE];
+  struct buf hdr;
+  int cnord;
+  int cord[LOGSIZE];
+  struct buf *cordbuf[LOGSIZE];
+
+  // the ring and the committed blocks not yet home,
+  // guarded by cklock.
+  struct sleeplock cklock;
+  int ring;        // ring slots, after the log super block
+  int head;        // next free ring slot
+  int used;        // slots used by the transactions in tx[]
+  int stale;       // slots freed since the last write_super()
+  uint64 rseq;     // sequence number of the next transaction
+  uint64 dseq;     // first one the on-disk log super block replays
+  struct logtx tx[LOGSIZE];
+  int txtail;      // oldest transaction in tx[]
+  int ntx;
+  struct logcopy copy[LOGSIZE];
+  int ckwant;      // the flusher should run now
+
+  uint64 ncommit;     // transactions committed
+  uint64 nlogwrite;   // blocks written to the log
+  uint64 nabsorb;     // log_write()s absorbed into a logged block
+  uint64 nlogwait;    // begin_op()s that waited for space
+  uint64 ndatawrite;  // file data blocks written in place
+  uint64 nckpt;       // committed blocks written home
+  uint64 nckskip;     // ... not written, logged again first
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void logcommitter(void);
+static void logflusher(void);
+
+// Blocks in the open transaction, logged or ordered data.
+// Caller must hold log.lock.
+static int
+txblocks(void)
+{
+  return log.lh.n + log.nord;
+}
+
+// If blockno is an ordered data block of the open
+// transaction, forget it and return 1.
+// Caller must hold log.lock.
+static int
+ordremove(int blockno)
+{
+  int i;
+
+  for(i = 0; i < log.nord; i++){
+    if(log.ord[i] == blockno){
+      log.ord[i] = log.ord[--log.nord];
+      return 1;
+    }
+  }
+  return 0;
+}
 
 void
 initlog(int dev, struct superblock *sb)
 {
+  int i;
+
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
   initlock(&log.lock, "log");
+  initsleeplock(&log.cklock, "logckpt");
+  initsleeplock(&log.hdr.lock, "loghdr");
+  for(i = 0; i < LOGSIZE; i++){
+    initsleeplock(&log.shadow[i].lock, "logshadow");
+    initsleeplock(&log.copy[i].b.lock, "logcopy");
+  }
   // mkfs里面规定是2
   log.start = sb->logstart;
-  // mkfs里面规定是LOGSIZE
-  log.size = sb->nlog;
+  // the first log block is the log super block, and the
+  // largest transaction must fit in the ring with its header.
+  // a ring with room for only one or two transactions would
+  // checkpoint before nearly every commit; mkfs -l enforces
+  // the same bounds.
+  log.ring = sb->nlog - 1;
+  log.size = log.ring - 1;
+  if(log.size < MAXOPBLOCKS*3 || log.size > LOGSIZE)
+    panic("initlog: bad log size");
   // 1
   log.dev = dev;
+  log.ordered = (sb->flags & FS_ORDERED) != 0;
+  if(log.ordered && sb->size > MAXFSSIZE)
+    panic("initlog: too big for ordered mode");
+  log.txid = 1;
   recover_from_log();
+  kthread("logcommit", logcommitter);
+  kthread("logflush", logflusher);
+}
+
+// 32-bit FNV-1a hash of n bytes at p, continuing from h.
+static uint
+logsum(uint h, void *p, int n)
+{
+  uchar *s = p;
+
+  while(n-- > 0){
+    h ^= *s++;
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Checksum of the header fields of h; the caller
+// continues it over the logged blocks' contents.
+static uint
+headsum(struct logheader *h)
+{
+  uint sum = 2166136261;
+
+  sum = logsum(sum, &h->seq, sizeof(h->seq));
+  sum = logsum(sum, &h->n, sizeof(h->n));
+  return logsum(sum, h->block, h->n * sizeof(h->block[0]));
+}
+
+// Disk block holding ring slot pos.
+static int
+slotblock(int pos)
+{
+  return log.start + 1 + pos;
+}
+
+// Read the header at ring slot pos into log.clh. Return its
+// block count if it is transaction seq and its checksum matches
+// the blocks after it, or -1 if it is stale or torn.
+static int
+read_head(int pos, uint64 seq)
+{
+  struct buf *buf;
+  struct logheader *lh;
+  uint sum;
+  int i;
+
+  if(pos + 1 >= log.ring)
+    return -1;
+  buf = bread(log.dev, slotblock(pos));
+  lh = (struct logheader *) (buf->data);
+  if(lh->seq != seq || lh->n <= 0 || lh->n > log.size ||
+     pos + 1 + lh->n > log.ring){
+    brelse(buf);
+    return -1;
+  }
+  log.clh = *lh;
+  brelse(buf);
+
+  sum = headsum(&log.clh);
+  for (i = 0; i < log.clh.n; i++) {
+    buf = bread(log.dev, slotblock(pos + 1 + i));
+    sum = logsum(sum, buf->data, BSIZE);
+    brelse(buf);
+  }
+  if(sum != log.clh.sum)
+    return -1;
+  return log.clh.n;
 }
 
-// Copy committed blocks from log to their home location
+// Copy the blocks of the transaction at ring slot pos,
+// described by log.clh, to their home locations.
 static void
-install_trans(int recovering)
+install_trans(int pos)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
+  for (tail = 0; tail < log.clh.n; tail++) {
+    struct buf *lbuf = bread(log.dev, slotblock(pos+1+tail)); // read log block
+    struct buf *dbuf = bread(log.dev, log.clh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
-    // 如果不是恢复的话 需要将这个buf取消置顶
-    // 如果是恢复的话 就不能需要置顶了
-    // log_write函数会置顶这个buf
-    if(recovering == 0)
-      bunpin(dbuf);
     brelse(lbuf);
     brelse(dbuf);
   }
 }
 
-// Read the log header from disk into the in-memory log header
+// Write the log super block: recovery starts at the oldest
+// transaction not yet checkpointed, or where the next one
+// will go. Frees copies that recovery can no longer replay.
 static void
-read_head(void)
+write_super(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  struct logsuper *ls = (struct logsuper *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+
+  if(log.ntx > 0){
+    ls->seq = log.tx[log.txtail].seq;
+    ls->pos = log.tx[log.txtail].pos;
+  } else {
+    ls->seq = log.rseq;
+    ls->pos = log.head;
   }
+  bwrite(buf);
+  log.dseq = ls->seq;
   brelse(buf);
+
+  log.stale = 0;
+  for(i = 0; i < LOGSIZE; i++){
+    if(log.copy[i].state == CK_HOME && log.copy[i].seq < log.dseq)
+      log.copy[i].state = CK_FREE;
+  }
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Replay every complete transaction from the one the log
+// super block names, in order, then empty the ring.
 static void
-write_head(void)
+recover_from_log(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+  uint64 seq = ls->seq;
+  int pos = ls->pos;
+
+  brelse(buf);
+  if(seq == 0){
+    // a new file system; mkfs zeroed the log.
+    seq = 1;
+    pos = 0;
+  }
+  for(;;){
+    if(read_head(pos, seq) < 0){
+      // the commit may have wrapped to the start of the ring;
+      // otherwise this is the end of the log.
+      pos = 0;
+      if(read_head(pos, seq) < 0)
+        break;
+    }
+    install_trans(pos); // committed; copy from log to disk
+    pos += 1 + log.clh.n;
+    seq++;
+  }
+  // 在这里被设置成0
+  log.clh.n = 0;
+  log.rseq = seq;
+  log.head = 0;
+  write_super(); // clear the log
+}
+
+// Index in log.tx[] of checkpointing transaction seq.
+static struct logtx*
+txof(uint64 seq)
+{
+  if(log.ntx == 0 || seq < log.tx[log.txtail].seq)
+    panic("txof");
+  return &log.tx[(log.txtail + (seq - log.tx[log.txtail].seq)) % LOGSIZE];
+}
+
+// The copy of blockno waiting for checkpoint, or 0.
+static struct logcopy*
+copyof(int blockno)
+{
   int i;
-  // 将所需要写的块的数量和块号记录进去
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+
+  for(i = 0; i < LOGSIZE; i++){
+    if(log.copy[i].state != CK_FREE && log.copy[i].b.blockno == blockno)
+      return &log.copy[i];
   }
-  bwrite(buf);
-  brelse(buf);
+  return 0;
 }
 
+// Unpin the cached block that a committed copy kept in place.
 static void
-recover_from_log(void)
+unpinhome(int blockno)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  // 在这里被设置成0
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct buf *b = bread(log.dev, blockno);
+  bunpin(b);
+  brelse(b);
+}
+
+// c no longer has to reach home: a later transaction logged
+// the block again, or it became file data.
+static void
+copydrop(struct logcopy *c)
+{
+  if(c->state == CK_DIRTY){
+    txof(c->seq)->nowned--;
+    unpinhome(c->b.blockno);
+  }
+  c->state = CK_FREE;
+}
+
+// Forget the oldest transactions once all their blocks are home
+// or logged again later. Their ring slots are free for reuse
+// after the next write_super().
+static void
+release_tx(void)
+{
+  while(log.ntx > 0 && log.tx[log.txtail].nowned == 0){
+    log.used -= log.tx[log.txtail].len;
+    log.stale += log.tx[log.txtail].len;
+    log.txtail = (log.txtail + 1) % LOGSIZE;
+    log.ntx--;
+  }
+}
+
+// Checkpoint: write every dirty copy logged by transaction seq
+// or earlier to its home location, all at once, and release
+// the transactions that leaves with nothing to do.
+static void
+checkpoint(uint64 seq)
+{
+  struct logcopy *c;
+  int i;
+
+  bplug();
+  for(i = 0; i < LOGSIZE; i++){
+    c = &log.copy[i];
+    if(c->state == CK_DIRTY && c->seq <= seq){
+      acquiresleep(&c->b.lock);
+      bwrite_async(&c->b);
+    }
+  }
+  bunplug();
+  for(i = 0; i < LOGSIZE; i++){
+    c = &log.copy[i];
+    if(c->state == CK_DIRTY && c->seq <= seq){
+      bwait(&c->b);
+      releasesleep(&c->b.lock);
+      c->state = CK_HOME;
+      txof(c->seq)->nowned--;
+      // the cached block may now be evicted and re-read.
+      unpinhome(c->b.blockno);
+      log.nckpt++;
+    }
+  }
+  release_tx();
+}
+
+// Find room in the ring for a transaction of n blocks plus its
+// header, checkpointing old transactions if need be. Returns
+// the slot for its header; *len gets the slots it uses.
+static int
+reserve_ring(int n, int *len)
+{
+  int pad;
+
+  for(;;){
+    if(log.used == 0 && log.stale == 0)
+      log.head = 0;  // recovery looks at slot 0 if not at head
+    pad = (log.head + 1 + n <= log.ring) ? 0 : log.ring - log.head;
+    if(log.used + log.stale + pad + 1 + n <= log.ring)
+      break;
+    if(log.stale > 0)
+      write_super();  // reclaim released slots
+    else
+      checkpoint(log.tx[log.txtail].seq);
+  }
+  *len = pad + 1 + n;
+  return pad ? 0 : log.head;
+}
+
+// Hand the just-committed transaction, at ring slot pos, to the
+// checkpointer: each block's frozen copy replaces any older copy
+// of the same block, and keeps the cached block pinned until it
+// is written home.
+static void
+add_tx(int pos, int len)
+{
+  struct logtx *t;
+  struct logcopy *c;
+  int i, j;
+
+  t = &log.tx[(log.txtail + log.ntx) % LOGSIZE];
+  t->seq = log.rseq++;
+  t->pos = pos;
+  t->len = len;
+  t->nowned = log.clh.n;
+  log.ntx++;
+  log.used += len;
+  log.head = pos + 1 + log.clh.n;
+
+  for(i = 0; i < log.clh.n; i++){
+    if((c = copyof(log.clh.block[i])) != 0){
+      if(c->state == CK_DIRTY)
+        log.nckskip++;   // a write home saved
+      copydrop(c);
+    }
+    for(j = 0; j < LOGSIZE && log.copy[j].state != CK_FREE; j++)
+      ;
+    if(j == LOGSIZE)
+      panic("add_tx: no copies");
+    c = &log.copy[j];
+    acquiresleep(&c->b.lock);
+    c->b.dev = log.dev;
+    c->b.blockno = log.clh.block[i];
+    memmove(c->b.data, log.shadow[i].data, BSIZE);
+    releasesleep(&c->b.lock);
+    c->state = CK_DIRTY;
+    c->seq = t->seq;
+  }
+  release_tx();
+  if(log.used > log.ring/2)
+    log.ckwant = 1;   // the flusher should catch up
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call that writes
+// at most MAXOPBLOCKS blocks.
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the start of an FS system call that writes
+// at most n blocks; n must not exceed log_opmax().
+void
+begin_opn(int n)
+{
+  int waited = 0;
+
+  if(n > log_opmax())
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
-  	// 判断日志系统是否正在提交
-    if(log.committing){
+  	// 判断日志系统是否正在冻结要提交的事务
+    if(log.freezing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.wantcommit && txblocks() > 0){
+      // let the open transaction drain so it can commit.
+      sleep(&log, &log.lock);
+    } else if(txblocks() + log.reserved + n > log.size){
     	// 判断是否还有空间可以写
-    	// 通过**log.outstanding**乘以**MAXOPBLOCKS**来计算已使用的日志空间
+    	// 用已经记录的块数加上正在执行的系统调用预留的块数来计算已使用的日志空间
       // this op might exhaust log space; wait for commit.
-      // 假设每次系统调用最多写入**MAXOPBLOCKS**个块。
+      if(!waited)
+        log.nlogwait++;
+      waited = 1;
+      log.wantcommit = 1;
+      wakeup(&log.clh);
       sleep(&log, &log.lock);
     } else {
 		// 记录多了一个系统调用在写
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
       release(&log.lock);
       break;
     }
@@ -156,75 +585,262 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// wakes the commit thread if the transaction is ready to go.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   // 减去一个系统调用
   log.outstanding -= 1;
-  // 结束完成之前不能提交
-  if(log.committing)
-    panic("log.committing");
-  // 如果没有系统调用在进行了 那么可以提交了 将多个系统调用合并成一次
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    // begin_op可能因为没有足够的空间而休眠，endop需要唤醒他
-    // outstanding的减少 恢复了保留空间
-    wakeup(&log);
+  log.reserved -= myproc()->logres;
+  myproc()->logres = 0;
+  if(log.outstanding == 0 &&
+     (log.wantcommit || txblocks() >= log.size/2)){
+    log.wantcommit = 1;
+    wakeup(&log.clh);
   }
+  // begin_op() may be waiting for log space,
+  // and releasing this call's reservation has
+  // decreased the amount of reserved space.
+  // begin_op可能因为没有足够的空间而休眠，endop需要唤醒他
+  // 释放预留 恢复了保留空间
+  wakeup(&log);
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    // 如果要提交的话，那么就在这里提交，提交完可以唤醒因为空间不足而睡眠的任务
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Copy the frozen blocks and the header to the ring, header
+// at slot pos. This is the true point at which the current
+// transaction commits. The header and log slots are adjacent,
+// so the disk layer merges these into a few large requests;
+// all of them are in flight before waiting for any, and the
+// checksum stands in for writing the header last.
+static void
+write_log(int pos)
+{
+  struct logheader *hb = (struct logheader *) (log.hdr.data);
+  int tail;
+
+  acquiresleep(&log.hdr.lock);
+  log.clh.seq = log.rseq;
+  log.clh.sum = headsum(&log.clh);
+  for (tail = 0; tail < log.clh.n; tail++)
+    log.clh.sum = logsum(log.clh.sum, log.shadow[tail].data, BSIZE);
+  // 将所需要写的块的数量和块号记录进去
+  memmove(hb, &log.clh, sizeof(log.clh));
+
+	// 将修改的每个块和日志头一起写入到日志块里面
+  bplug();
+  bwriteto(&log.hdr, slotblock(pos));
+  for (tail = 0; tail < log.clh.n; tail++)
+    bwriteto(&log.shadow[tail], slotblock(pos+1+tail));  // write the log
+  bunplug();
+  bwait(&log.hdr);
+  for (tail = 0; tail < log.clh.n; tail++)
+    bwait(&log.shadow[tail]);
+  releasesleep(&log.hdr.lock);
+}
+
+// A block about to be written in place as file data must not
+// be overwritten later by an older logged copy, neither by a
+// checkpoint nor by recovery replaying its transaction. Drop
+// such copies, and checkpoint until recovery cannot reach the
+// transactions that logged them.
+static void
+revoke_data(void)
+{
+  struct logcopy *c;
+  uint64 seq = 0;
+  int i;
+
+  acquiresleep(&log.cklock);
+  for(i = 0; i < log.cnord; i++){
+    if((c = copyof(log.cord[i])) != 0){
+      if(c->seq > seq)
+        seq = c->seq;
+      copydrop(c);
+    }
   }
+  if(seq >= log.dseq && seq > 0){
+    checkpoint(seq);
+    write_super();
+  }
+  releasesleep(&log.cklock);
 }
 
-// Copy modified blocks from cache to log.
+// Write the frozen transaction's file data blocks to their home
+// locations, straight from the cache, and unpin them. The open
+// transaction may want them meanwhile; it waits for the locks.
 static void
-write_log(void)
+write_data(void)
 {
-  int tail;
-	// 将修改的每个块写入到日志块里面
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  int i;
+
+  revoke_data();
+
+  for(i = 0; i < log.cnord; i++)
+    log.cordbuf[i] = bread(log.dev, log.cord[i]);
+  bplug();
+  for(i = 0; i < log.cnord; i++)
+    bwrite_async(log.cordbuf[i]);
+  bunplug();
+  for(i = 0; i < log.cnord; i++){
+    bwait(log.cordbuf[i]);
+    bunpin(log.cordbuf[i]);
+    brelse(log.cordbuf[i]);
+  }
+  log.ndatawrite += log.cnord;
+  log.cnord = 0;
+}
+
+// Commit the frozen transaction, whose id is id.
+static void
+commit(uint64 id)
+{
+  int pos, len;
+
+  if (log.clh.n == 0 && log.cnord == 0)
+    return;
+  if (log.cnord > 0)
+    write_data();    // Ordered data goes home before the commit
+  if (log.clh.n > 0) {
+    acquiresleep(&log.cklock);
+    pos = reserve_ring(log.clh.n, &len);
+    write_log(pos);  // Write frozen blocks and header -- the real commit
+    // The blocks stay dirty in the cache; the flusher
+    // installs them later, once however often they commit.
+    add_tx(pos, len);
+    log.nlogwrite += log.clh.n;
+    log.clh.n = 0;
+    releasesleep(&log.cklock);
+  }
+  acquire(&log.lock);
+  log.durable = id;
+  wakeup(&log.durable);
+  // its frees are on disk; the blocks may be used again.
+  if(log.nfreed[id%2] > 0){
+    memset(log.freed[id%2], 0, sizeof(log.freed[0]));
+    log.nfreed[id%2] = 0;
+  }
+  release(&log.lock);
+  log.ncommit++;
+}
+
+// The flusher thread. Every FLUSHTICKS ticks, or sooner if the
+// ring is filling up, writes all committed blocks home and
+// frees their ring slots. A block committed by many transactions
+// in that time is written home once.
+static void
+logflusher(void)
+{
+  uint t0;
+
+  for(;;){
+    acquire(&tickslock);
+    t0 = ticks;
+    while(ticks - t0 < FLUSHTICKS && !log.ckwant)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    acquiresleep(&log.cklock);
+    log.ckwant = 0;
+    if(log.ntx > 0)
+      checkpoint(log.tx[(log.txtail + log.ntx - 1) % LOGSIZE].seq);
+    if(log.stale > 0)
+      write_super();
+    releasesleep(&log.cklock);
   }
 }
 
+// Is the open transaction ready to commit?
+// Caller must hold log.lock.
+static int
+commitready(void)
+{
+  if(txblocks() == 0 || log.outstanding > 0)
+    return 0;
+  return log.wantcommit || ticks - log.opened >= COMMITTICKS;
+}
+
+// The commit thread. Waits for the open transaction to be
+// ready, freezes it, and writes it out while new system calls
+// fill the next one.
 static void
-commit()
+logcommitter(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+  int i, n;
+  uint64 id;
+
+  for(;;){
+    acquire(&log.lock);
+    while(!commitready()){
+      if(txblocks() > 0)
+        sleep(&ticks, &log.lock);   // check the time again next tick
+      else
+        sleep(&log.clh, &log.lock);
+    }
+
+    // no system call is active, and begin_op() waits while
+    // freezing is set, so no one can change lh's blocks while
+    // they are copied.
+    log.freezing = 1;
+    log.clh = log.lh;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    log.cnord = log.nord;
+    memmove(log.cord, log.ord, log.nord * sizeof(log.ord[0]));
+    log.nord = 0;
+    log.wantcommit = 0;
+    id = log.txid++;
+    release(&log.lock);
+
+    n = log.clh.n;
+    for(i = 0; i < n; i++){
+      struct buf *from = bread(log.dev, log.clh.block[i]); // cache block
+      acquiresleep(&log.shadow[i].lock);
+      log.shadow[i].dev = log.dev;
+      log.shadow[i].blockno = log.clh.block[i];
+      memmove(log.shadow[i].data, from->data, BSIZE);
+      brelse(from);
+    }
+
+    acquire(&log.lock);
+    log.freezing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    commit(id);
+
+    for(i = 0; i < n; i++)
+      releasesleep(&log.shadow[i].lock);
+  }
+}
+
+// Wait until every update made by system calls that have
+// already finished is on disk, committing the open
+// transaction early if need be. Must not be called inside
+// a transaction.
+void
+log_force(void)
+{
+  uint64 id;
+
+  acquire(&log.lock);
+  if(txblocks() > 0){
+    id = log.txid;
+    log.wantcommit = 1;
+    if(log.outstanding == 0)
+      wakeup(&log.clh);
+  } else {
+    // nothing open; wait for any commit in progress.
+    id = log.txid - 1;
   }
+  while(log.durable < id)
+    sleep(&log.durable, &log.lock);
+  release(&log.lock);
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// The commit thread will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -234,10 +850,10 @@ commit()
 void
 log_write(struct buf *b)
 {
-  int i;
+  int i, empty;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (txblocks() >= log.size)
   	// 已经不能再提交了，满了
     panic("too big a transaction");
   if (log.outstanding < 1)
@@ -245,15 +861,131 @@ log_write(struct buf *b)
 
   // 数据吸收 如果多次对一个块写入的话 那么只会记录一次
   for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorption
+    if (log.lh.block[i] == b->blockno){   // log absorption
+      log.nabsorb++;
       break;
+    }
   }
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
-  // 置顶一下 防止被LRU算法优化
-    bpin(b);
+    empty = txblocks() == 0;
+    // a file data block now holding metadata is journaled
+    // instead, and keeps the pin log_data() took.
+    if(!ordremove(b->blockno)){
+    // 置顶一下 防止被LRU算法优化
+      bpin(b);
+    }
+    if(empty){
+      log.opened = ticks;
+      wakeup(&log.clh);  // start the commit timer
+    }
     log.lh.n++;
   }
   release(&log.lock);
 }
 
+// Like log_write(), for a block of file data. In ordered mode
+// the block is not logged; the commit thread writes it home
+// before committing. A block that is also journaled in this
+// transaction stays journaled.
+void
+log_data(struct buf *b)
+{
+  int i;
+
+  if(!log.ordered){
+    log_write(b);
+    return;
+  }
+
+  acquire(&log.lock);
+  if (txblocks() >= log.size)
+    panic("too big a transaction");
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  for (i = 0; i < log.lh.n; i++) {
+    if (log.lh.block[i] == b->blockno)
+      goto absorbed;
+  }
+  for (i = 0; i < log.nord; i++) {
+    if (log.ord[i] == b->blockno)
+      goto absorbed;
+  }
+  bpin(b);
+  if(txblocks() == 0){
+    log.opened = ticks;
+    wakeup(&log.clh);  // start the commit timer
+  }
+  log.ord[log.nord++] = b->blockno;
+  release(&log.lock);
+  return;
+
+absorbed:
+  log.nabsorb++;
+  release(&log.lock);
+}
+
+// Note that the open transaction freed block blockno, which
+// must not be allocated again until the transaction commits.
+// Only ordered mode writes data in place, so only it needs to
+// keep track.
+void
+log_free(uint blockno)
+{
+  uchar *f;
+
+  if(!log.ordered)
+    return;
+  acquire(&log.lock);
+  f = log.freed[log.txid%2];
+  if((f[blockno/8] & (1 << (blockno%8))) == 0){
+    f[blockno/8] |= 1 << (blockno%8);
+    log.nfreed[log.txid%2]++;
+  }
+  release(&log.lock);
+}
+
+// Was block blockno freed by a transaction that has not
+// committed yet?
+int
+log_freed(uint blockno)
+{
+  int r;
+
+  if(!log.ordered)
+    return 0;
+  acquire(&log.lock);
+  r = ((log.freed[0][blockno/8] | log.freed[1][blockno/8]) & (1 << (blockno%8))) != 0;
+  release(&log.lock);
+  return r;
+}
+
+// Copy the log counters into *st.
+void
+logstat(struct iostat *st)
+{
+  acquire(&log.lock);
+  st->ncommit = log.ncommit;
+  st->nlogwrite = log.nlogwrite;
+  st->nabsorb = log.nabsorb;
+  st->nlogwait = log.nlogwait;
+  st->ndatawrite = log.ndatawrite;
+  st->nckpt = log.nckpt;
+  st->nckskip = log.nckskip;
+  st->logsize = log.size;
+  st->nfreeheld = log.nfreed[0] + log.nfreed[1];
+  st->ntxblocks = txblocks();
+  release(&log.lock);
+}
+
+// The most blocks one system call may reserve with begin_opn():
+// a quarter of the log, so a few large writers can share it,
+// but enough for a write of a block or two.
+int
+log_opmax(void)
+{
+  if(log.size/4 < MAXOPBLOCKS*2)
+    return MAXOPBLOCKS*2;
+  return log.size/4;
+}
@@ -2,12 +2,25 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // in-memory i-nodes kept before unused ones are reused
+#define NDCACHE     128  // directory entries cached by name
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
-#define MAXPATH      128   // maximum file path name
+#define MAXIOV       16  // max buffers in one readv() or writev()
+#define PIPEPAGES     1  // pages in a new pipe's buffer; a power of two
+#define MAXPIPEPAGES 16  // most pages F_SETPIPE_SZ may give a pipe; a power of two
+#define MAXOPBLOCKS  12  // max # of blocks most FS ops write
+#define LOGSIZE      126  // max data blocks in on-disk log; mkfs picks the size
+#define NBUF         (LOGSIZE*3+MAXOPBLOCKS*2)  // size of disk block cache; the open, committing and not-yet-home transactions may be pinned
+#define COMMITTICKS  1     // longest a log transaction stays open, in ticks
+#define FLUSHTICKS   30    // how often committed blocks are written home, in ticks
+#define FSSIZE       20000 // size of file system in blocks
+#define MAXFSSIZE    65536 // most blocks a file system in ordered mode may have
+#define BGBLOCKS     1024  // smallest block group (blocks); a power of two
+#define NBGROUP      64    // most block groups the allocator tracks
+#define MAXINODES    8192  // most inodes a file system may have
+#define PREALLOC     32    // largest preallocation window for a growing file (blocks)
+#define RAWINDOW      4    // default readahead window (blocks)
+#define MAXRAWINDOW  (NBUF/2)  // largest readahead window
+#define MAXPATH      512   // maximum file path name
@@ -8,21 +8,77 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
+// A pipe's buffer is a ring of size bytes in one or more
+// pages, size being a power of two so that the free-running
+// nread and nwrite index it modulo size even as they wrap.
+//
+// To save context switches, a writer wakes readers only if
+// one is asleep, which readers are only on an empty pipe, and
+// then only once it has filled the pipe or finished its
+// write.  A writer asleep on a full pipe says in wneed how
+// much room it waits for, at most half the buffer, and
+// readers wake it only once that much is free.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[MAXPIPEPAGES];  // the buffer
+  uint size;      // bytes in the buffer
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rbusy;      // a splice is reading the buffer in place
+  int wbusy;      // a splice is filling the buffer in place
+  int rsleep;     // readers asleep
+  uint wneed;     // room the writers asleep wait for, or 0
 };
 
+// Return the address of byte i of the ring of size bytes in
+// page[], and in *m the bytes from it to the end of its page.
+static char*
+pipeptr(char **page, uint size, uint i, uint *m)
+{
+  i &= size - 1;
+  *m = PGSIZE - i % PGSIZE;
+  return page[i / PGSIZE] + i % PGSIZE;
+}
+
+// Wake a reader asleep on pi if there is one.
+static void
+wakereaders(struct pipe *pi)
+{
+  if(pi->rsleep)
+    wakeup(&pi->nread);
+}
+
+// Wake the writers asleep on pi if they have the room they
+// wait for.
+static void
+wakewriters(struct pipe *pi)
+{
+  if(pi->wneed && pi->size - (pi->nwrite - pi->nread) >= pi->wneed){
+    pi->wneed = 0;
+    wakeup(&pi->nwrite);
+  }
+}
+
+// Sleep until pi has room for n more bytes, or half of its
+// buffer if that is less.
+static void
+waitroom(struct pipe *pi, uint n)
+{
+  n = min(n, pi->size / 2);
+  if(pi->wneed == 0 || n < pi->wneed)
+    pi->wneed = n;
+  sleep(&pi->nwrite, &pi->lock);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *pi;
+  int i;
 
   pi = 0;
   *f0 = *f1 = 0;
@@ -32,6 +88,11 @@ pipealloc(struct file **f0, struct file **f1)
   // 申请pipe结构体
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(pi, 0, sizeof(*pi));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((pi->page[i] = kalloc()) == 0)
+      goto bad;
+  pi->size = PIPEPAGES * PGSIZE;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -50,8 +111,11 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
+  if(pi){
+    for(i = 0; i < MAXPIPEPAGES && pi->page[i]; i++)
+      kfree(pi->page[i]);
     kfree((char*)pi);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -62,6 +126,8 @@ pipealloc(struct file **f0, struct file **f1)
 void
 pipeclose(struct pipe *pi, int writable)
 {
+  int i;
+
   acquire(&pi->lock);
   if(writable){
     pi->writeopen = 0;
@@ -72,6 +138,8 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(i = 0; i < pi->size / PGSIZE; i++)
+      kfree(pi->page[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
@@ -81,6 +149,8 @@ int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
   int i = 0;
+  uint m;
+  char *p;
   struct proc *pr = myproc();
 // 获取锁
   acquire(&pi->lock);
@@ -90,24 +160,29 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
+    if(pi->wbusy){
+      sleep(&pi->nwrite, &pi->lock);
 	// 判断pipe是否已经满了
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+    } else if(pi->nwrite == pi->nread + pi->size){ //DOC: pipewrite-full
     // 唤醒因读取pipe进入休眠的进程
-      wakeup(&pi->nread);
+      wakereaders(pi);
 	// 将当前写入休眠
-      sleep(&pi->nwrite, &pi->lock);
+      waitroom(pi, n - i);
     } else {
-      char ch;
-	  // 拷贝到ch里
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
+      // copy as much as there is room for before the end of
+      // a page of the ring; copyin() walks the page table
+      // once a page.
+      p = pipeptr(pi->page, pi->size, pi->nwrite, &m);
+      m = min(min(m, n - i), pi->size - (pi->nwrite - pi->nread));
 	  // 存储数据
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      if(copyin(pr->pagetable, p, addr + i, m) == -1)
+        break;
+      pi->nwrite += m;
+      i += m;
     }
   }
   // 唤醒读线程
-  wakeup(&pi->nread);
+  wakereaders(pi);
   release(&pi->lock);
 
   return i;
@@ -117,31 +192,199 @@ int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
   int i;
+  uint m;
+  char *p;
   struct proc *pr = myproc();
-  char ch;
 // 获取锁
   acquire(&pi->lock);
 // pipe是否只可读并且不为空
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->rbusy){  //DOC: pipe-empty
     if(killed(pr)){
       release(&pi->lock);
       return -1;
     }
 	// 睡眠
+    pi->rsleep++;
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    pi->rsleep--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
   // 判断是否为空
-    if(pi->nread == pi->nwrite)
-      break;
-	// 读取
-    ch = pi->data[pi->nread++ % PIPESIZE];
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    // up to the end of the data or of a page, whichever is first.
+    p = pipeptr(pi->page, pi->size, pi->nread, &m);
+    m = min(min(m, n - i), pi->nwrite - pi->nread);
 	// 复制到用户空间
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    if(copyout(pr->pagetable, addr + i, p, m) == -1)
       break;
+    pi->nread += m;
   }
   // 唤醒写进程
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  wakewriters(pi);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
+
+// Return the size of pi's buffer.
+int
+pipesize(struct pipe *pi)
+{
+  int n;
+
+  acquire(&pi->lock);
+  n = pi->size;
+  release(&pi->lock);
+  return n;
+}
+
+// Give pi a buffer of at least n bytes, rounded up to a power
+// of two pages, keeping the data in it.  Fails if that is more
+// than MAXPIPEPAGES pages, or too small for the data, or if a
+// splice is using the buffer.  Returns the new size.
+int
+piperesize(struct pipe *pi, int n)
+{
+  char *page[MAXPIPEPAGES], *old[MAXPIPEPAGES], *src, *dst;
+  uint np, oldnp, size, cnt, o, m, m1;
+  int i;
+
+  for(np = 1; np < MAXPIPEPAGES && np * PGSIZE < n; np *= 2)
+    ;
+  if(n < 0 || np * PGSIZE < n)
+    return -1;
+  size = np * PGSIZE;
+  for(i = 0; i < np; i++){
+    if((page[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(page[i]);
+      return -1;
+    }
+  }
+
+  acquire(&pi->lock);
+  cnt = pi->nwrite - pi->nread;
+  if(pi->rbusy || pi->wbusy || cnt > size){
+    release(&pi->lock);
+    for(i = 0; i < np; i++)
+      kfree(page[i]);
+    return -1;
+  }
+  // move the data to the start of the new ring.
+  for(o = 0; o < cnt; o += m){
+    src = pipeptr(pi->page, pi->size, pi->nread + o, &m);
+    dst = pipeptr(page, size, o, &m1);
+    m = min(min(m, m1), cnt - o);
+    memmove(dst, src, m);
+  }
+  oldnp = pi->size / PGSIZE;
+  for(i = 0; i < MAXPIPEPAGES; i++){
+    old[i] = pi->page[i];
+    pi->page[i] = i < np ? page[i] : 0;
+  }
+  pi->size = size;
+  pi->nread = 0;
+  pi->nwrite = cnt;
+  // the room writers wait for may be more than half the new
+  // buffer; let them look again.
+  pi->wneed = 0;
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+
+  for(i = 0; i < oldnp; i++)
+    kfree(old[i]);
+  return size;
+}
+
+// Splicing moves file data straight between the buffer cache
+// and the buffer, with readi() or writei(), which may sleep,
+// so it cannot hold pi->lock.  pipewbegin() instead hands out
+// free space at nwrite and marks the pipe wbusy, which keeps
+// other writers out until pipewend() commits what was filled;
+// readers never look past nwrite.  piperbegin() and
+// piperend() do the same for the data at nread, with rbusy.
+
+// Wait for room in pi and return in *dst and as the result
+// the contiguous free space at nwrite, at most n bytes.
+// Returns -1 if nobody can read pi.
+int
+pipewbegin(struct pipe *pi, char **dst, int n)
+{
+  struct proc *pr = myproc();
+  uint m;
+
+  acquire(&pi->lock);
+  for(;;){
+    if(pi->readopen == 0 || killed(pr)){
+      release(&pi->lock);
+      return -1;
+    }
+    if(pi->wbusy){
+      sleep(&pi->nwrite, &pi->lock);
+    } else if(pi->nwrite == pi->nread + pi->size){
+      wakereaders(pi);
+      waitroom(pi, n);
+    } else
+      break;
+  }
+  pi->wbusy = 1;
+  *dst = pipeptr(pi->page, pi->size, pi->nwrite, &m);
+  n = min(min(m, n), pi->size - (pi->nwrite - pi->nread));
+  release(&pi->lock);
+  return n;
+}
+
+// Commit m bytes filled in after pipewbegin().
+void
+pipewend(struct pipe *pi, int m)
+{
+  acquire(&pi->lock);
+  pi->nwrite += m;
+  pi->wbusy = 0;
+  wakereaders(pi);
+  // writers waiting for wbusy to clear.
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+}
+
+// Return in *src and as the result the contiguous data at
+// nread, at most n bytes, waiting for some if block is set.
+// Returns 0 at end of file or if no data is waiting and
+// block is clear, -1 if killed.
+int
+piperbegin(struct pipe *pi, char **src, int n, int block)
+{
+  struct proc *pr = myproc();
+  uint m;
+
+  acquire(&pi->lock);
+  while((pi->nread == pi->nwrite && pi->writeopen && block) || pi->rbusy){
+    if(killed(pr)){
+      release(&pi->lock);
+      return -1;
+    }
+    pi->rsleep++;
+    sleep(&pi->nread, &pi->lock);
+    pi->rsleep--;
+  }
+  if(pi->nread == pi->nwrite){
+    release(&pi->lock);
+    return 0;
+  }
+  pi->rbusy = 1;
+  *src = pipeptr(pi->page, pi->size, pi->nread, &m);
+  n = min(min(m, n), pi->nwrite - pi->nread);
+  release(&pi->lock);
+  return n;
+}
+
+// Consume m bytes after piperbegin().
+void
+piperend(struct pipe *pi, int m)
+{
+  acquire(&pi->lock);
+  pi->nread += m;
+  pi->rbusy = 0;
+  wakewriters(pi);
+  // readers waiting for rbusy to clear.
+  wakeup(&pi->nread);
+  release(&pi->lock);
+}
@@ -103,5 +103,7 @@ struct proc {
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  void (*kfn)(void);           // Body of a kernel thread, or 0
+  int logres;                  // Log blocks reserved by begin_op()
   char name[16];               // Process name (debugging)
 };
@@ -8,4 +8,60 @@ struct stat {
   short type;  // Type of file
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
+  uint blocks; // Disk blocks held, indirect blocks and extent nodes included
+};
+
+// A directory entry as getdents() returns it, with the inode
+// information that ls wants, so that listing a directory does
+// not need a stat() of every name.  getdents() packs records
+// one after another; reclen leads to the next.
+struct dent {
+  uint64 size;    // Size of file in bytes
+  uint ino;       // Inode number
+  short type;     // Type of file
+  ushort reclen;  // bytes from this record to the next
+  char name[];    // NUL-terminated
+};
+
+// bytes a dent for a name of len bytes takes
+#define DENTREC(len) ((sizeof(struct dent) + (len) + 1 + 7) & ~7)
+
+// Disk and buffer cache counters, filled in by iostat().
+struct iostat {
+  uint64 bread;      // bread() calls
+  uint64 bhit;       // bread() calls satisfied from the cache
+  uint64 diskread;   // blocks read from disk
+  uint64 diskwrite;  // blocks written to disk
+  uint64 raissued;   // readahead reads started
+  uint64 rahit;      // readahead blocks later used by bread()
+  uint64 rawasted;   // readahead blocks evicted before use
+  uint64 metaread;   // bread() calls for log, inode and bitmap blocks
+  uint64 metahit;    // ... satisfied from the cache
+  uint64 qdepth;     // disk requests the virtio queue can hold
+  uint64 maxinflight; // most disk requests outstanding at once
+  uint64 diskreq;    // requests given to the disk
+  uint64 diskseg;    // blocks in those requests (merging)
+  uint64 ncommit;    // log transactions committed
+  uint64 nlogwrite;  // blocks written to the log
+  uint64 nabsorb;    // log_write()s of blocks already in the transaction
+  uint64 nlogwait;   // begin_op()s that waited for log space
+  uint64 logsize;    // data blocks in the on-disk log
+  uint64 ndatawrite; // file data blocks written in place (FS_ORDERED)
+  uint64 nckpt;      // committed blocks written home by checkpoints
+  uint64 nckskip;    // ... not written, logged again before a checkpoint
+  uint64 nfree;      // free disk blocks
+  uint64 nalloc;     // blocks allocated by balloc()
+  uint64 nbscan;     // bitmap blocks balloc() examined to find them
+  uint64 nifree;     // free inodes
+  uint64 nprealloc;  // blocks allocated ahead of writes (fallocate, windows)
+  uint64 dchit;      // name lookups answered by the dentry cache
+  uint64 dcneghit;   // ... with "no such name"
+  uint64 dcmiss;     // name lookups that searched the directory
+  uint64 ninode;     // in-memory inode table entries
+  uint64 niget;      // iget() calls
+  uint64 nigethit;   // ... that found the inode already in the table
+  uint64 nunline;    // inline files moved out to a block as they grew
+  uint64 fsflags;    // superblock flags (FS_ORDERED, FS_EXTENTS, FS_INLINE)
+  uint64 nfreeheld;  // blocks freed by uncommitted transactions, not yet reusable
+  uint64 ntxblocks;  // blocks in the open transaction
 };
@@ -43,9 +43,21 @@ memmove(void *dst, const void *src, uint n)
     d += n;
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    // a word at a time once both are aligned, if they can be;
+    // copying forward, a word never overwrites source bytes
+    // still to be read.
+    if((((uint64)s ^ (uint64)d) & 7) == 0){
+      while(((uint64)d & 7) && n > 0){
+        *d++ = *s++;
+        n--;
+      }
+      for(; n >= 8; n -= 8, d += 8, s += 8)
+        *(uint64*)d = *(const uint64*)s;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
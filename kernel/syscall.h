@@ -20,3 +20,16 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_iostat 22
+#define SYS_setra  23
+#define SYS_fsync  24
+#define SYS_fallocate 25
+#define SYS_getdents 26
+#define SYS_pread  27
+#define SYS_pwrite 28
+#define SYS_lseek  29
+#define SYS_readv  30
+#define SYS_writev 31
+#define SYS_sendfile 32
+#define SYS_splice 33
+#define SYS_fcntl  34
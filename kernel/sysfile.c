@@ -107,6 +107,209 @@ sys_close(void)
   return 0;
 }
 
+// Read from fd at an offset, leaving fd's offset alone.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+// Write to fd at an offset, leaving fd's offset alone.
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// Set fd's offset; returns the new one.
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  argint(1, &off);
+  argint(2, &whence);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return fileseek(f, off, whence);
+}
+
+// Fetch the iovec array of readv() or writev() into iov,
+// checking that the total length fits in the return value.
+// Returns the number of buffers, or -1.
+static int
+argiov(struct iovec *iov)
+{
+  uint64 addr, tot;
+  int cnt, i;
+
+  argaddr(1, &addr);
+  argint(2, &cnt);
+  if(cnt < 0 || cnt > MAXIOV)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, addr, cnt * sizeof(*iov)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < cnt; i++)
+    tot += iov[i].iov_len;
+  if(tot > 0x7fffffff)
+    return -1;
+  return cnt;
+}
+
+// Read from fd into several buffers in turn.
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || (cnt = argiov(iov)) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+// Write several buffers to fd, one after another.
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || (cnt = argiov(iov)) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
+// sendfile(out, in, n): copy up to n bytes from the file
+// open as in, from its offset, to out without passing them
+// through user memory.
+uint64
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  int n;
+
+  argint(2, &n);
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0)
+    return -1;
+  if(in->type != FD_INODE)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// splice(in, out, n): move up to n bytes between a pipe and
+// a file, one of in and out being the pipe.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  argint(2, &n);
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0)
+    return -1;
+  if(in->type != FD_PIPE && out->type != FD_PIPE)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// fcntl(fd, cmd, arg): get or set the size of the buffer of
+// the pipe open as fd.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  argint(1, &cmd);
+  argint(2, &arg);
+  if(argfd(0, 0, &f) < 0 || f->type != FD_PIPE)
+    return -1;
+  if(cmd == F_GETPIPE_SZ)
+    return pipesize(f->pipe);
+  if(cmd == F_SETPIPE_SZ)
+    return piperesize(f->pipe, arg);
+  return -1;
+}
+
+// Return once every update to the file system made so far,
+// including those to fd's file, is on disk.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  log_force();
+  return 0;
+}
+
+// Allocate disk blocks for the first len bytes of fd's file,
+// without changing its size, so that writes that extend the
+// file to len bytes find contiguous blocks already allocated.
+uint64
+sys_fallocate(void)
+{
+  struct file *f;
+  int len, n, r;
+
+  argint(1, &len);
+  if(argfd(0, 0, &f) < 0 || len < 0)
+    return -1;
+  if(f->type != FD_INODE || f->writable == 0)
+    return -1;
+  n = ((uint)len + BSIZE - 1) / BSIZE;
+  // one run of blocks per transaction.
+  do {
+    begin_op();
+    ilock(f->ip);
+    r = (f->ip->type == T_FILE) ? iprealloc(f->ip, n) : -1;
+    iunlock(f->ip);
+    end_op();
+  } while(r >= 0 && r < n);
+  return r < 0 ? -1 : 0;
+}
+
+// Read directory entries, with their inodes' type and size,
+// from directory fd into buf as struct dents, at most n bytes
+// of them.  Returns the number of bytes read, 0 at the end.
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  uint64 buf;
+  int n;
+
+  argaddr(1, &buf);
+  argint(2, &n);
+  if(argfd(0, 0, &f) < 0 || n < 0)
+    return -1;
+  return filedents(f, buf, n);
+}
+
 uint64
 sys_fstat(void)
 {
@@ -175,16 +378,19 @@ bad:
 }
 
 // Is the directory dp empty except for "." and ".." ?
+// They are its first two records; only the records' headers
+// need to be read.
 static int
 isdirempty(struct inode *dp)
 {
-  int off;
+  int off, n;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+  n = 0;
+  for(off=0; off<dp->size; off+=de.reclen){
+    if(readi(dp, 0, (uint64)&de, off, DIRHDR) != DIRHDR || de.reclen == 0)
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && ++n > 2)
       return 0;
   }
   return 1;
@@ -194,7 +400,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -224,9 +429,8 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, off);
+  dcinval(dp->dev, dp->inum, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -531,3 +735,32 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// Copy disk and buffer cache counters to user space.
+uint64
+sys_iostat(void)
+{
+  uint64 addr; // user pointer to struct iostat
+  struct iostat st;
+
+  argaddr(0, &addr);
+  memset(&st, 0, sizeof(st));
+  bstat(&st);
+  virtio_disk_stat(&st);
+  logstat(&st);
+  allocstat(&st);
+  dcstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Set the readahead window in blocks; returns the old window.
+uint64
+sys_setra(void)
+{
+  int n;
+
+  argint(0, &n);
+  return setrawindow(n);
+}
@@ -45,9 +45,15 @@
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
 
-// this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// at most this many virtio descriptors; the queue size
+// actually used is negotiated with the device by
+// virtio_disk_init(). must be a power of two.
+#define NUM 256
+
+// most blocks merged into one request, and most
+// requests waiting to be merged.
+#define MAXSEG 16
+#define NPEND  64
 
 // a single descriptor, from the spec.
 struct virtq_desc {
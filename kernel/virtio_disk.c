@@ -4,6 +4,13 @@
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// requests are not handed to the device one at a time. they
+// wait, sorted by block number, in a small pending queue until
+// someone waits for one of them or the last caller that
+// plugged the queue (virtio_disk_plug()) unplugs it. runs of
+// adjacent blocks in the same direction then go to the device
+// as one request with one data descriptor per block.
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -15,6 +22,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "stat.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -22,7 +30,7 @@
 static struct disk {
   // a set (not a ring) of DMA descriptors, with which the
   // driver tells the device where to read and write individual
-  // disk operations. there are NUM descriptors.
+  // disk operations. there are num descriptors.
   // most commands consist of a "chain" (a linked list) of a couple of
   // these descriptors.
   struct virtq_desc *desc;
@@ -30,26 +38,44 @@ static struct disk {
   // a ring in which the driver writes descriptor numbers
   // that the driver would like the device to process.  it only
   // includes the head descriptor of each chain. the ring has
-  // NUM elements.
+  // num elements.
   struct virtq_avail *avail;
 
   // a ring in which the device writes descriptor numbers that
   // the device has finished processing (just the head of each chain).
-  // there are NUM used ring entries.
+  // there are num used ring entries.
   struct virtq_used *used;
 
   // our own book-keeping.
+  int num;         // queue size agreed with the device, <= NUM.
   char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // we've looked this far in used[2..NUM].
+  uint16 used_idx; // we've looked this far in used[2..num].
+  int nfree;       // number of free descriptors.
+  int inflight;    // requests the device has not finished.
+  int maxinflight; // most requests ever in flight at once.
+  int maxseg;      // most blocks merged into one request.
+
+  // buffers not yet given to the device, sorted by
+  // (write, blockno).
+  struct {
+    struct buf *b;
+    uint blockno;
+    int write;
+  } pend[NPEND];
+  int npend;
+  int plugged;     // callers between plug and unplug.
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b;   // first buf; the rest linked by b->qnext.
     char status;
   } info[NUM];
 
+  uint64 nreq;     // requests given to the device.
+  uint64 nseg;     // blocks in those requests.
+
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
@@ -114,8 +140,14 @@ virtio_disk_init(void)
   uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
-  if(max < NUM)
+  // use the deepest queue both sides support, so that many
+  // requests can be outstanding at once.
+  disk.num = NUM;
+  while(disk.num > max)
+    disk.num /= 2;
+  if(disk.num < 3)
     panic("virtio disk max queue too short");
+  disk.maxseg = disk.num - 2 < MAXSEG ? disk.num - 2 : MAXSEG;
 
   // allocate and zero queue memory.
   disk.desc = kalloc();
@@ -128,7 +160,7 @@ virtio_disk_init(void)
   memset(disk.used, 0, PGSIZE);
 
   // set queue size.
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  *R(VIRTIO_MMIO_QUEUE_NUM) = disk.num;
 
   // write physical addresses.
   *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
@@ -141,9 +173,10 @@ virtio_disk_init(void)
   // queue is ready.
   *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
 
-  // all NUM descriptors start out unused.
-  for(int i = 0; i < NUM; i++)
+  // all num descriptors start out unused.
+  for(int i = 0; i < disk.num; i++)
     disk.free[i] = 1;
+  disk.nfree = disk.num;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
@@ -156,9 +189,10 @@ virtio_disk_init(void)
 static int
 alloc_desc()
 {
-  for(int i = 0; i < NUM; i++){
+  for(int i = 0; i < disk.num; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
+      disk.nfree--;
       return i;
     }
   }
@@ -169,7 +203,7 @@ alloc_desc()
 static void
 free_desc(int i)
 {
-  if(i >= NUM)
+  if(i >= disk.num)
     panic("free_desc 1");
   if(disk.free[i])
     panic("free_desc 2");
@@ -178,6 +212,7 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
+  disk.nfree++;
   wakeup(&disk.free[0]);
 }
 
@@ -196,44 +231,31 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int n, int *idx)
 {
-  for(int i = 0; i < 3; i++){
+  if(disk.nfree < n)
+    return -1;
+  for(int i = 0; i < n; i++)
     idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
-    }
-  }
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// format the descriptors of a request for the n pending
+// bufs starting at pend[first], which are adjacent blocks
+// going the same way, and hand the chain to the device.
+// the spec's Section 5.2 says that block operations use one
+// descriptor for type/reserved/sector, one for each piece of
+// data, and one for a 1-byte status result.
+// caller holds disk.vdisk_lock and has allocated idx[0..n+1].
+static void
+submit_req(int first, int n, int *idx)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  int write = disk.pend[first].write;
+  uint64 sector = disk.pend[first].blockno * (BSIZE / 512);
 
-  acquire(&disk.vdisk_lock);
-
-  // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
-  // format the three descriptors.
-  // qemu's virtio-blk.c reads them.
+  // qemu's virtio-blk.c reads the descriptors.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
 
@@ -249,45 +271,172 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(int i = 0; i < n; i++){
+    struct buf *b = disk.pend[first+i].b;
+    int d = idx[i+1];
+
+    disk.desc[d].addr = (uint64) b->data;
+    disk.desc[d].len = BSIZE;
+    if(write)
+      disk.desc[d].flags = 0; // device reads b->data
+    else
+      disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[d].flags |= VRING_DESC_F_NEXT;
+    disk.desc[d].next = idx[i+2];
+
+    // record the bufs for virtio_disk_intr().
+    b->qnext = (i+1 < n) ? disk.pend[first+i+1].b : 0;
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.info[idx[0]].b = disk.pend[first].b;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  disk.avail->ring[disk.avail->idx % disk.num] = idx[0];
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  disk.avail->idx += 1; // not % num ...
 
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
+  disk.nreq++;
+  disk.nseg += n;
+  if(++disk.inflight > disk.maxinflight)
+    disk.maxinflight = disk.inflight;
+}
+
+// hand every pending buf to the device, merging runs of
+// adjacent blocks. sleeps if the ring is full.
+// caller holds disk.vdisk_lock.
+static void
+flush_pending(void)
+{
+  int n, idx[MAXSEG+2];
+
+  while(disk.npend > 0){
+    // the longest run of adjacent blocks at the front.
+    for(n = 1; n < disk.npend && n < disk.maxseg; n++){
+      if(disk.pend[n].write != disk.pend[0].write ||
+         disk.pend[n].blockno != disk.pend[n-1].blockno + 1)
+        break;
+    }
+    if(alloc_descs(n+2, idx) < 0){
+      // another flusher may take over the queue meanwhile,
+      // so look at it afresh after sleeping.
+      sleep(&disk.free[0], &disk.vdisk_lock);
+      continue;
+    }
+    submit_req(0, n, idx);
+    disk.npend -= n;
+    memmove(&disk.pend[0], &disk.pend[n], disk.npend * sizeof(disk.pend[0]));
+  }
+}
+
+// Queue a read or write of b's data from or to disk block
+// blockno (normally b->blockno; the log writes cached blocks
+// into its own area). b must be locked and stay locked until
+// the request finishes: virtio_disk_intr() then clears b->disk
+// and wakes up virtio_disk_wait(), and, if b->async is set,
+// hands b to bdone(). Unless the queue is plugged the request
+// goes to the device at once. Sleeps if the queue or ring is
+// full, or returns -1 instead if nowait is set. Returns 0 once
+// the request is queued.
+int
+virtio_disk_submit(struct buf *b, uint blockno, int write, int nowait)
+{
+  int i;
+
+  acquire(&disk.vdisk_lock);
+
+  if(nowait && (disk.npend == NPEND || disk.nfree < 3)){
+    release(&disk.vdisk_lock);
+    return -1;
+  }
+  if(disk.npend == NPEND)
+    flush_pending();
+
+  // insert in (write, blockno) order.
+  for(i = disk.npend; i > 0; i--){
+    if(disk.pend[i-1].write < write ||
+       (disk.pend[i-1].write == write && disk.pend[i-1].blockno < blockno))
+      break;
+    disk.pend[i] = disk.pend[i-1];
+  }
+  disk.pend[i].b = b;
+  disk.pend[i].blockno = blockno;
+  disk.pend[i].write = write;
+  disk.npend++;
+  b->disk = 1;
+
+  if(disk.plugged == 0)
+    flush_pending();
+
+  release(&disk.vdisk_lock);
+  return 0;
+}
+
+// Hold back requests from the device, so that those
+// submitted before the matching virtio_disk_unplug()
+// can be merged.
+void
+virtio_disk_plug(void)
+{
+  acquire(&disk.vdisk_lock);
+  disk.plugged++;
+  release(&disk.vdisk_lock);
+}
+
+void
+virtio_disk_unplug(void)
+{
+  acquire(&disk.vdisk_lock);
+  if(--disk.plugged == 0)
+    flush_pending();
+  release(&disk.vdisk_lock);
+}
+
+// Wait for virtio_disk_intr() to say the request for b,
+// started by virtio_disk_submit(), has finished.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  // b may still be waiting in the pending queue.
+  if(b->disk == 1)
+    flush_pending();
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
+  release(&disk.vdisk_lock);
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(b, b->blockno, write, 0);
+  virtio_disk_wait(b);
+}
 
+// Report the queue depth in use, the most requests that
+// have been outstanding at once, and how many blocks were
+// merged into how many requests.
+void
+virtio_disk_stat(struct iostat *st)
+{
+  acquire(&disk.vdisk_lock);
+  st->qdepth = disk.num / 3;
+  st->maxinflight = disk.maxinflight;
+  st->diskreq = disk.nreq;
+  st->diskseg = disk.nseg;
   release(&disk.vdisk_lock);
 }
 
@@ -311,14 +460,25 @@ virtio_disk_intr()
 
   while(disk.used_idx != disk.used->idx){
     __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+    int id = disk.used->ring[disk.used_idx % disk.num].id;
 
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    disk.info[id].b = 0;
+    free_chain(id);
+    disk.inflight--;
+
+    while(b){
+      struct buf *next = b->qnext;
+      b->qnext = 0;
+      b->disk = 0;   // disk is done with buf
+      wakeup(b);
+      if(b->async)
+        bdone(b);   // no one waits for b; release it
+      b = next;
+    }
 
     disk.used_idx += 1;
   }
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,7 +23,8 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE+2;  // log super, header and data blocks; -l sets the data part
+uint fsflags;          // superblock flags; -o sets FS_ORDERED, -e FS_EXTENTS, -i FS_INLINE
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -40,6 +42,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void dirappend(uint dinum, char *name, uint inum);
+void dirflush(uint dinum);
 void die(const char *);
 
 // convert to riscv byte order
@@ -69,21 +73,46 @@ int
 main(int argc, char *argv[])
 {
   int i, cc, fd;
-  uint rootino, inum, off;
-  struct dirent de;
+  uint rootino, inum;
   char buf[BSIZE];
-  struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  while(argc >= 2 && argv[1][0] == '-'){
+    if(strcmp(argv[1], "-l") == 0 && argc >= 3){
+      nlog = atoi(argv[2]) + 2;
+      if(nlog-2 < MAXOPBLOCKS*3 || nlog-2 > LOGSIZE){
+        fprintf(stderr, "mkfs: log size must be %d..%d blocks\n",
+                MAXOPBLOCKS*3, LOGSIZE);
+        exit(1);
+      }
+      argc--;
+      argv++;
+    } else if(strcmp(argv[1], "-o") == 0){
+      fsflags |= FS_ORDERED;
+    } else if(strcmp(argv[1], "-e") == 0){
+      fsflags |= FS_EXTENTS;
+    } else if(strcmp(argv[1], "-i") == 0){
+      fsflags |= FS_INLINE;
+    } else {
+      argc = 0;
+      break;
+    }
+    argc--;
+    argv++;
+  }
+
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-l logblocks] [-o] [-e] [-i] fs.img files...\n");
     exit(1);
   }
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
-  assert((BSIZE % sizeof(struct dirent)) == 0);
+  assert(sizeof(((struct dinode*)0)->data) >= sizeof(((struct dinode*)0)->addrs));
+  assert(offsetof(struct dirent, name) == DIRHDR);
+  assert(DIRREC(DIRSIZ) <= BSIZE / 2);
+  assert(DXROOT + sizeof(struct dxhead) <= BSIZE);
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0)
@@ -101,6 +130,7 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.flags = xint(fsflags);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -117,16 +147,10 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 //为根目录添加一个目录 指向根目录inode
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
+  dirappend(rootino, ".", rootino);
 
   //为根目录添加一个目录 指向根目录inode
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  dirappend(rootino, "..", rootino);
 // 读取所有要写入文件系统的文件
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -152,10 +176,7 @@ main(int argc, char *argv[])
 // 为该文件分配inode
     inum = ialloc(T_FILE);
 //将文件都添加到根目录下
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    dirappend(rootino, shortname, inum);
 // 将文件内容添加到文件对应的inode下
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -163,13 +184,8 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
-  // 向上BSIZE对齐
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  // write the root directory's last block
+  dirflush(rootino);
 
   balloc(freeblock);
 
@@ -229,6 +245,8 @@ ialloc(ushort type)
 
   bzero(&din, sizeof(din));
   din.type = xshort(type);
+  if(type == T_FILE && (fsflags & FS_INLINE))
+    din.flags = xint(DI_INLINE);
   din.nlink = xshort(1);
   din.size = xint(0);
   winode(inum, &din);
@@ -253,6 +271,59 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the address of block bn below the indirect block
+// *root, level levels deep, allocating blocks as needed.
+uint
+indirect(uint *root, uint bn, int level)
+{
+  uint a[NINDIRECT];
+  uint span, i, x;
+
+  if(xint(*root) == 0)
+    *root = xint(freeblock++);
+  x = xint(*root);
+  for(span = 1, i = 1; i < level; i++)
+    span *= NINDIRECT;
+  for(; level > 0; level--, span /= NINDIRECT){
+    rsect(x, (char*)a);
+    i = bn / span;
+    bn %= span;
+    if(a[i] == 0){
+      a[i] = xint(freeblock++);
+      wsect(x, (char*)a);
+    }
+    x = xint(a[i]);
+  }
+  return x;
+}
+
+// Return the address of block fbn of din on an FS_EXTENTS
+// file system, allocating it. mkfs writes each file at once,
+// so its blocks are contiguous and the root's extents suffice.
+uint
+extent(struct dinode *din, uint fbn)
+{
+  struct exthdr *h = (struct exthdr*)din->addrs;
+  struct extent *e = (struct extent*)(h + 1);
+  ushort n = xshort(h->n);
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(fbn >= xint(e[i].lblk) && fbn - xint(e[i].lblk) < xint(e[i].len))
+      return xint(e[i].pblk) + fbn - xint(e[i].lblk);
+  }
+  if(n > 0 && xint(e[n-1].pblk) + xint(e[n-1].len) == freeblock){
+    e[n-1].len = xint(xint(e[n-1].len) + 1);
+    return freeblock++;
+  }
+  assert(n < NIEXTENT);
+  e[n].lblk = xint(fbn);
+  e[n].pblk = xint(freeblock);
+  e[n].len = xint(1);
+  h->n = xshort(n + 1);
+  return freeblock++;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -260,30 +331,44 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
   off = xint(din.size);
+  if(xint(din.flags) & DI_INLINE){
+    if(off + n <= NINLINE){
+      bcopy(p, din.data + off, n);
+      din.size = xint(off + n);
+      winode(inum, &din);
+      return;
+    }
+    // too big for the dinode: move what is there to a block.
+    bcopy(din.data, buf, off);
+    bzero(din.data, NINLINE);
+    din.flags = xint(xint(din.flags) & ~DI_INLINE);
+    din.size = xint(0);
+    winode(inum, &din);
+    iappend(inum, buf, off);
+    rinode(inum, &din);
+  }
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
+    if(fsflags & FS_EXTENTS){
+      x = extent(&din, fbn);
+    } else if(fbn < NDIRECT){
       if(xint(din.addrs[fbn]) == 0){
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
+    } else if(fbn < NDIRECT + NINDIRECT){
+      x = indirect(&din.addrs[NDIRECT], fbn - NDIRECT, 1);
+    } else if(fbn < NDIRECT + NINDIRECT + NDINDIRECT){
+      x = indirect(&din.addrs[NDIRECT+1], fbn - NDIRECT - NINDIRECT, 2);
     } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
+      x = indirect(&din.addrs[NDIRECT+2],
+                   fbn - NDIRECT - NINDIRECT - NDINDIRECT, 3);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
@@ -297,6 +382,46 @@ iappend(uint inum, void *xp, int n)
   winode(inum, &din);
 }
 
+// The directory block being filled by dirappend(), the
+// offset of its next record, and the last record in it.
+char dirbuf[BSIZE];
+uint dirpos;
+struct dirent *dirlast;
+
+// Append the directory dinum's current block, the last record
+// taking up the rest of it.
+void
+dirflush(uint dinum)
+{
+  if(dirlast == 0)
+    return;
+  dirlast->reclen = xshort(xshort(dirlast->reclen) + BSIZE - dirpos);
+  iappend(dinum, dirbuf, BSIZE);
+  bzero(dirbuf, BSIZE);
+  dirpos = 0;
+  dirlast = 0;
+}
+
+// Add (name, inum) to directory dinum. Records go into a block
+// in memory until it is full, so that none crosses a block.
+void
+dirappend(uint dinum, char *name, uint inum)
+{
+  struct dirent *de;
+  int len = strlen(name);
+
+  assert(len <= DIRSIZ);
+  if(dirpos + DIRREC(len) > BSIZE)
+    dirflush(dinum);
+  de = (struct dirent*)(dirbuf + dirpos);
+  de->inum = xint(inum);
+  de->reclen = xshort(DIRREC(len));
+  de->namelen = len;
+  memmove(de->name, name, len);
+  dirpos += DIRREC(len);
+  dirlast = de;
+}
+
 void
 die(const char *s)
 {
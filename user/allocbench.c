@@ -0,0 +1,116 @@
+// Measure block allocation on a nearly full, fragmented disk:
+// fill the disk with files, delete every fourth one to leave
+// holes all over it, then time writing new files into them.
+//
+// usage: allocbench [blocks-to-leave-free]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define FILLBLOCKS 256  // blocks in each fill file
+#define NEWBLOCKS  32   // blocks in each timed file
+#define MAXFILES   100
+#define CHUNK      8    // blocks per write
+
+char buf[CHUNK*BSIZE];
+
+// Name file i of kind c.
+char *
+fname(char c, int i)
+{
+  static char name[8];
+
+  name[0] = 'a';
+  name[1] = c;
+  name[2] = '0' + i / 100;
+  name[3] = '0' + (i / 10) % 10;
+  name[4] = '0' + i % 10;
+  name[5] = 0;
+  return name;
+}
+
+// Write a file of n blocks; returns the blocks written.
+int
+wfile(char *name, int n)
+{
+  int fd, i, m;
+
+  if((fd = open(name, O_CREATE | O_WRONLY)) < 0){
+    printf("allocbench: cannot create %s\n", name);
+    exit(1);
+  }
+  for(i = 0; i < n; i += m){
+    m = n - i < CHUNK ? n - i : CHUNK;
+    if(write(fd, buf, m * BSIZE) != m * BSIZE)
+      break;
+  }
+  close(fd);
+  return i;
+}
+
+int
+nfree(void)
+{
+  struct iostat st;
+
+  iostat(&st);
+  return st.nfree;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int leave = 200, nfill, nnew, i, n, blocks, t0, t1;
+  struct iostat s0, s1;
+
+  if(argc > 1)
+    leave = atoi(argv[1]);
+  if(leave < 0){
+    printf("usage: allocbench [blocks-to-leave-free]\n");
+    exit(1);
+  }
+  memset(buf, 'a', sizeof(buf));
+
+  // fill the disk, leaving some room for indirect blocks.
+  for(nfill = 0; nfill < MAXFILES && nfree() > leave + FILLBLOCKS + 2; nfill++)
+    wfile(fname('f', nfill), FILLBLOCKS);
+  if(nfree() > leave + 2)
+    wfile(fname('f', nfill++), nfree() - leave - 2);
+  printf("allocbench: %d fill files, %d blocks free\n", nfill, nfree());
+
+  // punch holes.
+  for(i = 0; i < nfill; i += 4)
+    unlink(fname('f', i));
+  printf("allocbench: %d blocks free after deleting every fourth file\n",
+         nfree());
+
+  // allocate almost all of the free blocks again.
+  iostat(&s0);
+  t0 = uptime();
+  blocks = 0;
+  for(nnew = 0; nnew < MAXFILES && nfree() > leave + NEWBLOCKS + 2; nnew++){
+    n = wfile(fname('n', nnew), NEWBLOCKS);
+    blocks += n;
+    if(n < NEWBLOCKS){
+      nnew++;
+      break;
+    }
+  }
+  t1 = uptime();
+  iostat(&s1);
+
+  printf("allocbench: %d files, %d blocks in %d ticks\n", nnew, blocks, t1 - t0);
+  n = s1.nalloc - s0.nalloc;
+  if(n > 0)
+    printf("allocbench: %d allocations, %d bitmap block reads (%d per 100)\n",
+           n, (int)(s1.nbscan - s0.nbscan), (int)((s1.nbscan - s0.nbscan) * 100 / n));
+
+  for(i = 0; i < nnew; i++)
+    unlink(fname('n', i));
+  for(i = 0; i < nfill; i++)
+    unlink(fname('f', i));
+  exit(0);
+}
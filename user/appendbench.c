@@ -0,0 +1,110 @@
+// Grow several files at once, a small record at a time, the
+// way log files are written, then read each one back and
+// report how many disk requests that took; contiguous files
+// are read in few, large requests.
+//
+// usage: appendbench [-f] [nfiles [kbytes]]
+//   -f: fallocate each file to its final size first
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define RECORD 100
+
+char buf[8*BSIZE];
+
+char *
+fname(int i)
+{
+  static char name[8];
+
+  name[0] = 'a';
+  name[1] = 'p';
+  name[2] = '0' + i;
+  name[3] = 0;
+  return name;
+}
+
+// Append kb kbytes to file i in RECORD-byte writes.
+void
+appender(int i, int kb, int prealloc)
+{
+  int fd, n;
+
+  if((fd = open(fname(i), O_CREATE | O_WRONLY)) < 0){
+    printf("appendbench: cannot create %s\n", fname(i));
+    exit(1);
+  }
+  if(prealloc && fallocate(fd, kb * 1024) < 0){
+    printf("appendbench: fallocate failed\n");
+    exit(1);
+  }
+  memset(buf, 'a' + i, RECORD);
+  for(n = 0; n < kb * 1024; n += RECORD){
+    if(write(fd, buf, RECORD) != RECORD){
+      printf("appendbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfiles = 4, kb = 128, prealloc = 0, i, fd, t0, t1;
+  struct iostat s0, s1;
+
+  if(argc > 1 && strcmp(argv[1], "-f") == 0){
+    prealloc = 1;
+    argc--;
+    argv++;
+  }
+  if(argc > 1)
+    nfiles = atoi(argv[1]);
+  if(argc > 2)
+    kb = atoi(argv[2]);
+  if(nfiles <= 0 || nfiles > 10 || kb <= 0){
+    printf("usage: appendbench [-f] [nfiles <= 10 [kbytes]]\n");
+    exit(1);
+  }
+
+  iostat(&s0);
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++){
+    if(fork() == 0)
+      appender(i, kb, prealloc);
+  }
+  for(i = 0; i < nfiles; i++)
+    wait(0);
+  t1 = uptime();
+  iostat(&s1);
+  printf("appendbench: %d files of %d KB in %d-byte writes, %d ticks\n",
+         nfiles, kb, RECORD, t1 - t0);
+  printf("appendbench: %d blocks allocated, %d of them ahead of the writes\n",
+         (int)(s1.nalloc - s0.nalloc), (int)(s1.nprealloc - s0.nprealloc));
+
+  // the files together are bigger than the buffer cache, so
+  // most of their blocks come from disk.
+  iostat(&s0);
+  for(i = 0; i < nfiles; i++){
+    if((fd = open(fname(i), O_RDONLY)) < 0){
+      printf("appendbench: cannot open %s\n", fname(i));
+      exit(1);
+    }
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+  iostat(&s1);
+  printf("appendbench: read back %d blocks from disk in %d requests\n",
+         (int)(s1.diskread - s0.diskread), (int)(s1.diskreq - s0.diskreq));
+
+  for(i = 0; i < nfiles; i++)
+    unlink(fname(i));
+  exit(0);
+}
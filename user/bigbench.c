@@ -0,0 +1,109 @@
+// Stream a large file, one that needs double-indirect blocks,
+// to disk and back, and report the throughput.
+//
+// usage: bigbench [kbytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define CHUNK (8*BSIZE)
+
+char *file = "bigbench.tmp";
+char buf[CHUNK];
+
+// Fill buf with a pattern that identifies chunk i.
+void
+fill(int i)
+{
+  int j;
+
+  for(j = 0; j < CHUNK; j += sizeof(int))
+    *(int*)(buf + j) = i * CHUNK + j;
+}
+
+// Print n kbytes over t ticks as KB/sec.
+void
+rate(char *what, int kb, int t)
+{
+  if(t > 0)
+    printf("bigbench: %s %d ticks, about %d KB/sec\n", what, t, kb * TICKSPERSEC / t);
+  else
+    printf("bigbench: %s under a tick\n", what);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 4096, n, i, j, fd, t0, t1;
+  struct iostat s0, s1;
+  struct stat st;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb <= 0 || kb % (CHUNK/1024) != 0){
+    printf("usage: bigbench [kbytes, a multiple of %d]\n", CHUNK/1024);
+    exit(1);
+  }
+  n = kb / (CHUNK/1024);
+
+  unlink(file);
+  fd = open(file, O_CREATE | O_WRONLY);
+  if(fd < 0){
+    printf("bigbench: cannot create %s\n", file);
+    exit(1);
+  }
+  iostat(&s0);
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    fill(i);
+    if(write(fd, buf, CHUNK) != CHUNK){
+      printf("bigbench: write failed at %d KB\n", i * (CHUNK/1024));
+      exit(1);
+    }
+  }
+  fsync(fd);
+  t1 = uptime();
+  iostat(&s1);
+  close(fd);
+  rate("write", kb, t1 - t0);
+  printf("bigbench: %d commits, %d log blocks, %d data blocks in place\n",
+         (int)(s1.ncommit - s0.ncommit), (int)(s1.nlogwrite - s0.nlogwrite),
+         (int)(s1.ndatawrite - s0.ndatawrite));
+
+  if(stat(file, &st) < 0 || st.size != (uint64)kb * 1024){
+    printf("bigbench: %s has the wrong size\n", file);
+    exit(1);
+  }
+
+  fd = open(file, O_RDONLY);
+  if(fd < 0){
+    printf("bigbench: cannot open %s\n", file);
+    exit(1);
+  }
+  iostat(&s0);
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(read(fd, buf, CHUNK) != CHUNK){
+      printf("bigbench: short read at %d KB\n", i * (CHUNK/1024));
+      exit(1);
+    }
+    for(j = 0; j < CHUNK; j += sizeof(int)){
+      if(*(int*)(buf + j) != i * CHUNK + j){
+        printf("bigbench: wrong data at %d KB\n", i * (CHUNK/1024));
+        exit(1);
+      }
+    }
+  }
+  t1 = uptime();
+  iostat(&s1);
+  close(fd);
+  rate("read", kb, t1 - t0);
+  printf("bigbench: %d blocks read from disk in %d requests\n",
+         (int)(s1.diskread - s0.diskread), (int)(s1.diskreq - s0.diskreq));
+
+  unlink(file);
+  exit(0);
+}
@@ -0,0 +1,95 @@
+// Time sequential reads of a large file, 512 bytes at a
+// time the way cat does, at several readahead windows.
+//
+// usage: catbench [kbytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define NPASS 4
+
+char *file = "catbench.tmp";
+char buf[512];
+int windows[] = { 0, 2, 4, 8, 15 };
+
+void
+mkfile(int kb)
+{
+  int fd, i;
+
+  unlink(file);
+  fd = open(file, O_CREATE | O_WRONLY);
+  if(fd < 0){
+    printf("catbench: cannot create %s\n", file);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  for(i = 0; i < kb * 2; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("catbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+void
+readfile(void)
+{
+  int fd, n;
+
+  fd = open(file, O_RDONLY);
+  if(fd < 0){
+    printf("catbench: cannot open %s\n", file);
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    ;
+  if(n < 0){
+    printf("catbench: read error\n");
+    exit(1);
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 200, i, p, t0, t1, old;
+  struct iostat s0, s1;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb <= 0 || kb > MAXFILE){
+    printf("catbench: kbytes must be 1..%d\n", (int)MAXFILE);
+    exit(1);
+  }
+
+  mkfile(kb);
+  old = setra(0);
+
+  printf("catbench: %d KB x %d passes\n", kb, NPASS);
+  printf("window ticks diskread rahit rawasted requests\n");
+  for(i = 0; i < sizeof(windows)/sizeof(windows[0]); i++){
+    setra(windows[i]);
+    iostat(&s0);
+    t0 = uptime();
+    for(p = 0; p < NPASS; p++)
+      readfile();
+    t1 = uptime();
+    iostat(&s1);
+    printf("%d %d %d %d %d %d\n", windows[i], t1 - t0,
+           (int)(s1.diskread - s0.diskread),
+           (int)(s1.rahit - s0.rahit),
+           (int)(s1.rawasted - s0.rawasted),
+           (int)(s1.diskreq - s0.diskreq));
+  }
+
+  setra(old);
+  unlink(file);
+  exit(0);
+}
@@ -0,0 +1,73 @@
+// Measure log commit throughput: create, write and close
+// many small files, each of which is its own transaction.
+//
+// usage: commitbench [nfiles]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char data[100];
+
+int
+main(int argc, char *argv[])
+{
+  int n = 200, i, fd, t0, t1, ticks, commits;
+  char name[8];
+  struct iostat s0, s1;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0 || n > 1000){
+    printf("usage: commitbench [nfiles <= 1000]\n");
+    exit(1);
+  }
+  memset(data, 'c', sizeof(data));
+
+  name[0] = 'c';
+  name[1] = 'b';
+  name[5] = 0;
+  iostat(&s0);
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    name[2] = '0' + i / 100;
+    name[3] = '0' + (i / 10) % 10;
+    name[4] = '0' + i % 10;
+    if((fd = open(name, O_CREATE | O_WRONLY)) < 0){
+      printf("commitbench: cannot create %s\n", name);
+      exit(1);
+    }
+    if(write(fd, data, sizeof(data)) != sizeof(data)){
+      printf("commitbench: write failed\n");
+      exit(1);
+    }
+    close(fd);
+  }
+  t1 = uptime();
+  iostat(&s1);
+
+  ticks = t1 - t0;
+  commits = s1.ncommit - s0.ncommit;
+  printf("commitbench: %d files, %d commits, %d log blocks, %d ticks\n",
+         n, commits, (int)(s1.nlogwrite - s0.nlogwrite), ticks);
+  if(ticks > 0)
+    printf("commitbench: about %d commits/sec\n", commits * TICKSPERSEC / ticks);
+  printf("commitbench: %d blocks in %d disk requests\n",
+         (int)(s1.diskseg - s0.diskseg), (int)(s1.diskreq - s0.diskreq));
+  printf("commitbench: %d log writes absorbed, %d waits for a %d-block log\n",
+         (int)(s1.nabsorb - s0.nabsorb), (int)(s1.nlogwait - s0.nlogwait),
+         (int)s1.logsize);
+  printf("commitbench: %d data blocks written in place\n",
+         (int)(s1.ndatawrite - s0.ndatawrite));
+  printf("commitbench: %d blocks checkpointed, %d writes saved by relogging\n",
+         (int)(s1.nckpt - s0.nckpt), (int)(s1.nckskip - s0.nckskip));
+
+  for(i = 0; i < n; i++){
+    name[2] = '0' + i / 100;
+    name[3] = '0' + (i / 10) % 10;
+    name[4] = '0' + i % 10;
+    unlink(name);
+  }
+  exit(0);
+}
@@ -0,0 +1,75 @@
+// Measure file creation on a file system whose low-numbered
+// inodes are in use: create files until only a few inodes are
+// left free, then time creating more.
+//
+// usage: createbench [nfiles]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define LEAVE 10  // inodes to leave free
+
+// Name file i.
+char *
+fname(int i)
+{
+  static char name[8];
+
+  name[0] = 'c';
+  name[1] = 'r';
+  name[2] = '0' + i / 100;
+  name[3] = '0' + (i / 10) % 10;
+  name[4] = '0' + i % 10;
+  name[5] = 0;
+  return name;
+}
+
+void
+create(int i)
+{
+  int fd;
+
+  if((fd = open(fname(i), O_CREATE | O_WRONLY)) < 0){
+    printf("createbench: cannot create %s\n", fname(i));
+    exit(1);
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 50, nfill, i, t0, t1;
+  struct iostat s0, s1;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  iostat(&s0);
+  if(n <= 0 || n > s0.nifree - LEAVE){
+    printf("usage: createbench [nfiles <= %d]\n", (int)s0.nifree - LEAVE);
+    exit(1);
+  }
+
+  // use up the inodes that the timed creates would otherwise find first.
+  nfill = s0.nifree - LEAVE - n;
+  for(i = 0; i < nfill; i++)
+    create(i);
+
+  iostat(&s0);
+  t0 = uptime();
+  for(i = nfill; i < nfill + n; i++)
+    create(i);
+  t1 = uptime();
+  iostat(&s1);
+
+  printf("createbench: %d files after %d others, %d ticks\n", n, nfill, t1 - t0);
+  printf("createbench: %d inode/bitmap/log block reads (%d per file), %d from disk\n",
+         (int)(s1.metaread - s0.metaread), (int)((s1.metaread - s0.metaread) / n),
+         (int)(s1.diskread - s0.diskread));
+
+  for(i = 0; i < nfill + n; i++)
+    unlink(fname(i));
+  exit(0);
+}
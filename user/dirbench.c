@@ -0,0 +1,121 @@
+// Measure name lookup and creation in one big directory: link
+// a file under n names in a new directory, look each name up,
+// list the directory with getdents(), then remove the names.
+//
+// usage: dirbench [n]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char *dir = "dirbench.d";
+char dents[4096];
+
+// Name i, inside dir.
+char *
+fname(int i)
+{
+  static char name[32];
+  int j;
+
+  strcpy(name, dir);
+  j = strlen(name);
+  name[j++] = '/';
+  name[j++] = 'n';
+  name[j++] = '0' + i / 10000 % 10;
+  name[j++] = '0' + i / 1000 % 10;
+  name[j++] = '0' + i / 100 % 10;
+  name[j++] = '0' + i / 10 % 10;
+  name[j++] = '0' + i % 10;
+  name[j] = 0;
+  return name;
+}
+
+// Print what n operations took over t ticks.
+void
+report(char *what, int n, int t)
+{
+  if(t > 0)
+    printf("dirbench: %d %s in %d ticks, about %d/sec\n", n, what, t, n * TICKSPERSEC / t);
+  else
+    printf("dirbench: %d %s in under a tick\n", n, what);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 10000, i, fd, t0, t1, r, off, calls, seen;
+  char target[32];
+  struct stat st;
+  struct iostat s0, s1;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0 || n > 30000){
+    printf("usage: dirbench [n <= 30000]\n");
+    exit(1);
+  }
+
+  if(mkdir(dir) < 0){
+    printf("dirbench: cannot make %s\n", dir);
+    exit(1);
+  }
+  strcpy(target, dir);
+  strcpy(target + strlen(target), "/target");
+  if((fd = open(target, O_CREATE | O_WRONLY)) < 0){
+    printf("dirbench: cannot create %s\n", target);
+    exit(1);
+  }
+  close(fd);
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(link(target, fname(i)) < 0){
+      printf("dirbench: link %s failed\n", fname(i));
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  report("creates", n, t1 - t0);
+
+  iostat(&s0);
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(stat(fname(i), &st) < 0){
+      printf("dirbench: stat %s failed\n", fname(i));
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  iostat(&s1);
+  report("lookups", n, t1 - t0);
+  printf("dirbench: %d block reads per lookup\n", (int)((s1.bread - s0.bread) / n));
+
+  // what ls costs: one getdents() per buffer full of entries,
+  // rather than a read() and a stat() per entry.
+  t0 = uptime();
+  calls = seen = 0;
+  if((fd = open(dir, O_RDONLY)) < 0){
+    printf("dirbench: cannot open %s\n", dir);
+    exit(1);
+  }
+  while((r = getdents(fd, (struct dent*)dents, sizeof(dents))) > 0){
+    calls++;
+    for(off = 0; off < r; off += ((struct dent*)(dents + off))->reclen)
+      seen++;
+  }
+  close(fd);
+  t1 = uptime();
+  report("entries listed", seen, t1 - t0);
+  printf("dirbench: %d getdents() calls\n", calls);
+
+  t0 = uptime();
+  for(i = 0; i < n; i++)
+    unlink(fname(i));
+  t1 = uptime();
+  report("unlinks", n, t1 - t0);
+  unlink(target);
+  unlink(dir);
+  exit(0);
+}
@@ -1,12 +1,13 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
-#include "kernel/fs.h"
+
+#define NAMEW 14  // names shorter than this are padded to line up
 
 char*
 fmtname(char *path)
 {
-  static char buf[DIRSIZ+1];
+  static char buf[NAMEW+1];
   char *p;
 
   // Find first character after last slash.
@@ -15,19 +16,21 @@ fmtname(char *path)
   p++;
 
   // Return blank-padded name.
-  if(strlen(p) >= DIRSIZ)
+  if(strlen(p) >= NAMEW)
     return p;
   memmove(buf, p, strlen(p));
-  memset(buf+strlen(p), ' ', DIRSIZ-strlen(p));
+  memset(buf+strlen(p), ' ', NAMEW-strlen(p));
   return buf;
 }
 
+// getdents() fills this with a batch of entries at a time.
+char dents[4096];
+
 void
 ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, n, off;
+  struct dent *d;
   struct stat st;
 
   if((fd = open(path, 0)) < 0){
@@ -48,24 +51,16 @@ ls(char *path)
     break;
 
   case T_DIR:
-    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof(buf)){
-      printf("ls: path too long\n");
-      break;
-    }
-    strcpy(buf, path);
-    p = buf+strlen(buf);
-    *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf("ls: cannot stat %s\n", buf);
-        continue;
+    // each entry comes with its inode's type and size, so
+    // there is no need to stat() it by name.
+    while((n = getdents(fd, (struct dent*)dents, sizeof(dents))) > 0){
+      for(off = 0; off < n; off += d->reclen){
+        d = (struct dent*)(dents + off);
+        printf("%s %d %d %d\n", fmtname(d->name), d->type, d->ino, (int)d->size);
       }
-      printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
     }
+    if(n < 0)
+      printf("ls: cannot read %s\n", path);
     break;
   }
   close(fd);
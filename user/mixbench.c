@@ -0,0 +1,129 @@
+// Mixed workload for the buffer cache: one process streams
+// a large file over and over, the way cat, wc or grep would,
+// while another creates, stats and removes small files.
+// Reports how often metadata (inode, bitmap, log) blocks
+// were found in the cache.
+//
+// usage: mixbench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define BIGKB 200
+
+char *bigfile = "mixbench.big";
+char buf[512];
+
+void
+mkbig(void)
+{
+  int fd, i;
+
+  unlink(bigfile);
+  fd = open(bigfile, O_CREATE | O_WRONLY);
+  if(fd < 0){
+    printf("mixbench: cannot create %s\n", bigfile);
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < BIGKB * 2; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("mixbench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+// stream the big file rounds times.
+void
+scanner(int rounds)
+{
+  int fd, i;
+
+  for(i = 0; i < rounds; i++){
+    if((fd = open(bigfile, O_RDONLY)) < 0){
+      printf("mixbench: cannot open %s\n", bigfile);
+      exit(1);
+    }
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+}
+
+// small-file metadata work.
+void
+smallfiles(int rounds)
+{
+  char name[8];
+  struct stat st;
+  int fd, i, j;
+
+  name[0] = 'm';
+  name[1] = 'x';
+  name[3] = 0;
+  for(i = 0; i < rounds * 4; i++){
+    for(j = 0; j < 10; j++){
+      name[2] = '0' + j;
+      if((fd = open(name, O_CREATE | O_WRONLY)) < 0){
+        printf("mixbench: cannot create %s\n", name);
+        exit(1);
+      }
+      write(fd, name, sizeof(name));
+      close(fd);
+      stat(name, &st);
+    }
+    for(j = 0; j < 10; j++){
+      name[2] = '0' + j;
+      unlink(name);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 4, pid, t0, t1;
+  struct iostat s0, s1;
+  int metaread, metahit, nread, hit;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0){
+    printf("usage: mixbench [rounds]\n");
+    exit(1);
+  }
+
+  mkbig();
+  iostat(&s0);
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("mixbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    scanner(rounds);
+    exit(0);
+  }
+  smallfiles(rounds);
+  wait(0);
+  t1 = uptime();
+  iostat(&s1);
+
+  metaread = s1.metaread - s0.metaread;
+  metahit = s1.metahit - s0.metahit;
+  nread = s1.bread - s0.bread;
+  hit = s1.bhit - s0.bhit;
+  printf("mixbench: %d rounds, %d ticks\n", rounds, t1 - t0);
+  printf("metadata: %d reads, %d hits (%d%%)\n", metaread, metahit,
+         metaread ? metahit * 100 / metaread : 0);
+  printf("all:      %d reads, %d hits (%d%%), %d from disk\n", nread, hit,
+         nread ? hit * 100 / nread : 0, (int)(s1.diskread - s0.diskread));
+
+  unlink(bigfile);
+  exit(0);
+}
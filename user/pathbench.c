@@ -0,0 +1,82 @@
+// Measure open() of a file six directories deep, which looks
+// up seven path components each time, and how often the
+// directory entry cache answers those lookups.
+//
+// usage: pathbench [nopens]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define DEPTH 6
+
+char path[64];
+
+int
+main(int argc, char *argv[])
+{
+  int n = 1000, i, fd, len, t0, t1;
+  struct iostat s0, s1;
+  uint64 hits, lookups;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf("usage: pathbench [nopens]\n");
+    exit(1);
+  }
+
+  // pbdir0/pbdir1/.../pbdir5/file
+  len = 0;
+  for(i = 0; i < DEPTH; i++){
+    strcpy(path + len, "pbdir0");
+    path[len + 5] = '0' + i;
+    len += 6;
+    if(mkdir(path) < 0){
+      printf("pathbench: cannot make %s\n", path);
+      exit(1);
+    }
+    path[len++] = '/';
+  }
+  strcpy(path + len, "file");
+  if((fd = open(path, O_CREATE | O_WRONLY)) < 0){
+    printf("pathbench: cannot create %s\n", path);
+    exit(1);
+  }
+  close(fd);
+
+  iostat(&s0);
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf("pathbench: cannot open %s\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+  t1 = uptime();
+  iostat(&s1);
+
+  printf("pathbench: %d opens of %s in %d ticks\n", n, path, t1 - t0);
+  if(t1 > t0)
+    printf("pathbench: about %d opens/sec\n", n * TICKSPERSEC / (t1 - t0));
+  hits = (s1.dchit - s0.dchit) + (s1.dcneghit - s0.dcneghit);
+  lookups = hits + (s1.dcmiss - s0.dcmiss);
+  if(lookups > 0)
+    printf("pathbench: %d of %d name lookups hit the dentry cache (%d%%)\n",
+           (int)hits, (int)lookups, (int)(hits * 100 / lookups));
+  printf("pathbench: %d block reads per open\n", (int)((s1.bread - s0.bread) / n));
+  printf("pathbench: %d of %d igets found the inode in memory\n",
+         (int)(s1.nigethit - s0.nigethit), (int)(s1.niget - s0.niget));
+
+  // remove from the deepest up.
+  for(i = DEPTH; i >= 0; i--){
+    unlink(path);
+    while(len > 0 && path[len-1] != '/')
+      len--;
+    if(len > 0)
+      path[--len] = 0;
+  }
+  exit(0);
+}
@@ -0,0 +1,100 @@
+// Measure pipe throughput: a child writes messages of each of
+// several sizes into a pipe and the parent reads them out,
+// and report the bytes moved per tick, with pipes of the
+// default size and resized with F_SETPIPE_SZ.
+//
+// usage: pipebench [kbytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+int sizes[] = { 1, 16, 128, 512, 4096, 16384 };
+int pipesizes[] = { 0, 16384, 65536 };   // 0: the default
+
+char buf[16384];
+
+// Move total bytes through a pipe of psize bytes, or of the
+// default size if psize is 0, in writes and reads of size
+// bytes each and return the ticks it took.
+int
+run(int size, int total, int psize)
+{
+  int fds[2], n, got, t0, t1, xst;
+
+  if(pipe(fds) < 0){
+    printf("pipebench: pipe failed\n");
+    exit(1);
+  }
+  if(psize && fcntl(fds[1], F_SETPIPE_SZ, psize) != psize){
+    printf("pipebench: cannot make a pipe of %d bytes\n", psize);
+    exit(1);
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(n = 0; n < total; n += size)
+      if(write(fds[1], buf, size) != size){
+        printf("pipebench: write failed\n");
+        exit(1);
+      }
+    exit(0);
+  }
+  close(fds[1]);
+  got = 0;
+  while((n = read(fds[0], buf, size)) > 0)
+    got += n;
+  close(fds[0]);
+  wait(&xst);
+  t1 = uptime();
+  if(got != total || xst != 0){
+    printf("pipebench: read %d bytes of %d\n", got, total);
+    exit(1);
+  }
+  return t1 - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 1024, i, j, size, psize, total, t, fds[2];
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb <= 0 || kb > 65536){
+    printf("usage: pipebench [kbytes <= 65536]\n");
+    exit(1);
+  }
+  memset(buf, 'p', sizeof(buf));
+  if(pipe(fds) < 0){
+    printf("pipebench: pipe failed\n");
+    exit(1);
+  }
+  printf("pipebench: default pipe size %d\n", fcntl(fds[0], F_GETPIPE_SZ, 0));
+  close(fds[0]);
+  close(fds[1]);
+
+  for(j = 0; j < sizeof(pipesizes)/sizeof(pipesizes[0]); j++){
+    psize = pipesizes[j];
+    for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+      size = sizes[i];
+      // a system call per byte is slow enough on its own;
+      // move less with the smallest messages.
+      total = kb * 1024;
+      if(size < 128)
+        total /= 16;
+      total -= total % size;
+      t = run(size, total, psize);
+      if(psize)
+        printf("pipebench: %d-byte pipe, ", psize);
+      else
+        printf("pipebench: default pipe, ");
+      printf("%d-byte messages: %d KB in %d ticks", size, total / 1024, t);
+      if(t > 0)
+        printf(", %d KB/tick", total / 1024 / t);
+      printf("\n");
+    }
+  }
+  exit(0);
+}
@@ -0,0 +1,78 @@
+// Measure the space and reads that small files cost: create
+// nfiles files of size bytes each, then read them all back.
+// On a file system with FS_INLINE, files of up to NINLINE
+// bytes need no data block, and reading one needs no bread()
+// beyond its inode block's.
+//
+// usage: smallbench [nfiles [size]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+char data[BSIZE];
+
+// Name file i.
+char *
+fname(int i)
+{
+  static char name[8];
+
+  name[0] = 's';
+  name[1] = 'b';
+  name[2] = '0' + i / 100;
+  name[3] = '0' + (i / 10) % 10;
+  name[4] = '0' + i % 10;
+  name[5] = 0;
+  return name;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 100, size = 64, i, fd, t0, t1;
+  struct iostat s0, s1, s2;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    size = atoi(argv[2]);
+  if(n <= 0 || n > 1000 || size < 0 || size > BSIZE){
+    printf("usage: smallbench [nfiles <= 1000 [size <= %d]]\n", BSIZE);
+    exit(1);
+  }
+  memset(data, 'x', size);
+
+  iostat(&s0);
+  for(i = 0; i < n; i++){
+    if((fd = open(fname(i), O_CREATE | O_WRONLY)) < 0 ||
+       write(fd, data, size) != size){
+      printf("smallbench: cannot write %s\n", fname(i));
+      exit(1);
+    }
+    close(fd);
+  }
+  iostat(&s1);
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if((fd = open(fname(i), O_RDONLY)) < 0 || read(fd, data, BSIZE) != size){
+      printf("smallbench: cannot read %s\n", fname(i));
+      exit(1);
+    }
+    close(fd);
+  }
+  t1 = uptime();
+  iostat(&s2);
+
+  printf("smallbench: %d files of %d bytes use %d blocks, %d inline\n",
+         n, size, (int)(s0.nfree - s1.nfree), size <= NINLINE && s0.nfree == s1.nfree);
+  printf("smallbench: reading them took %d ticks, %d bread()s (%d from disk)\n",
+         t1 - t0, (int)(s2.bread - s1.bread), (int)(s2.diskread - s1.diskread));
+
+  for(i = 0; i < n; i++)
+    unlink(fname(i));
+  exit(0);
+}
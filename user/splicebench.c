@@ -0,0 +1,149 @@
+// Time a cat | wc pipeline over a file, with cat copying
+// through user memory with read() and write(), and with cat
+// using sendfile(), which fills the pipe straight from the
+// buffer cache.  A third run drains the pipe into a file,
+// with write() and with splice().
+//
+// usage: splicebench [kbytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char *file = "splicebench.tmp";
+char *outfile = "splicebench.out";
+
+char buf[512];
+
+// Count the bytes and lines coming out of fd, like wc.
+int
+wc(int fd, int *lines)
+{
+  int i, n, c = 0;
+
+  *lines = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    for(i = 0; i < n; i++)
+      if(buf[i] == '\n')
+        (*lines)++;
+    c += n;
+  }
+  return c;
+}
+
+// Copy file into fd like cat, with sendfile() if zc is set.
+void
+cat(int fd, int zc)
+{
+  int in, n;
+
+  if((in = open(file, O_RDONLY)) < 0){
+    printf("splicebench: cannot open %s\n", file);
+    exit(1);
+  }
+  if(zc){
+    while((n = sendfile(fd, in, 8192)) > 0)
+      ;
+  } else {
+    while((n = read(in, buf, sizeof(buf))) > 0)
+      if(write(fd, buf, n) != n){
+        n = -1;
+        break;
+      }
+  }
+  if(n < 0){
+    printf("splicebench: copy failed\n");
+    exit(1);
+  }
+  close(in);
+}
+
+// Run cat | wc, or cat into a pipe drained into outfile if
+// tofile is set, and return the ticks it took.
+int
+run(int zc, int tofile, int size)
+{
+  int fds[2], t0, t1, c, lines, n, out, xst;
+
+  if(pipe(fds) < 0){
+    printf("splicebench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    cat(fds[1], zc);
+    exit(0);
+  }
+  close(fds[1]);
+  if(tofile){
+    if((out = open(outfile, O_CREATE | O_TRUNC | O_WRONLY)) < 0){
+      printf("splicebench: cannot create %s\n", outfile);
+      exit(1);
+    }
+    c = 0;
+    if(zc){
+      while((n = splice(fds[0], out, 8192)) > 0)
+        c += n;
+    } else {
+      while((n = read(fds[0], buf, sizeof(buf))) > 0 && write(out, buf, n) == n)
+        c += n;
+    }
+    close(out);
+  } else {
+    c = wc(fds[0], &lines);
+  }
+  close(fds[0]);
+  wait(&xst);
+  t1 = uptime();
+  if(c != size || xst != 0){
+    printf("splicebench: moved %d bytes of %d\n", c, size);
+    exit(1);
+  }
+  return t1 - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 256, i, fd, t;
+  char line[64];
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb <= 0 || kb > 4096){
+    printf("usage: splicebench [kbytes <= 4096]\n");
+    exit(1);
+  }
+
+  if((fd = open(file, O_CREATE | O_TRUNC | O_WRONLY)) < 0){
+    printf("splicebench: cannot create %s\n", file);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(line) - 1; i++)
+    line[i] = 'a' + i % 26;
+  line[sizeof(line) - 1] = '\n';
+  for(i = 0; i < kb * 1024 / sizeof(line); i++)
+    if(write(fd, line, sizeof(line)) != sizeof(line)){
+      printf("splicebench: cannot write %s\n", file);
+      exit(1);
+    }
+  close(fd);
+
+  // warm the buffer cache.
+  run(0, 0, kb * 1024);
+
+  t = run(0, 0, kb * 1024);
+  printf("splicebench: cat | wc, read/write: %d KB in %d ticks\n", kb, t);
+  t = run(1, 0, kb * 1024);
+  printf("splicebench: cat | wc, sendfile:   %d KB in %d ticks\n", kb, t);
+  t = run(0, 1, kb * 1024);
+  printf("splicebench: cat | file, read/write:      %d KB in %d ticks\n", kb, t);
+  t = run(1, 1, kb * 1024);
+  printf("splicebench: cat | file, sendfile/splice: %d KB in %d ticks\n", kb, t);
+
+  unlink(file);
+  unlink(outfile);
+  exit(0);
+}
@@ -1,4 +1,7 @@
 struct stat;
+struct iostat;
+struct dent;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -22,6 +25,20 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+#define TICKSPERSEC 10  // uptime() ticks per second, about, in qemu
+int iostat(struct iostat*);
+int setra(int);
+int fsync(int);
+int fallocate(int, int);
+int getdents(int, struct dent*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int lseek(int, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int sendfile(int, int, int);
+int splice(int, int, int);
+int fcntl(int, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
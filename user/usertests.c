@@ -575,9 +575,11 @@ writetest(char *s)
   }
 }
 
+// write a file big enough to need double-indirect blocks.
 void
 writebig(char *s)
 {
+  enum { NBIG = NDIRECT + NINDIRECT + 2*NINDIRECT + 3 };
   int i, fd, n;
 
   fd = open("big", O_CREATE|O_RDWR);
@@ -586,7 +588,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < NBIG; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -606,7 +608,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != NBIG){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -1396,10 +1398,9 @@ concreate(char *s)
   char file[3];
   int i, pid, n, fd;
   char fa[N];
-  struct {
-    ushort inum;
-    char name[DIRSIZ];
-  } de;
+  char blk[BSIZE];
+  struct dirent *de;
+  uint off;
 
   file[0] = 'C';
   file[2] = '\0';
@@ -1432,17 +1433,18 @@ concreate(char *s)
   memset(fa, 0, sizeof(fa));
   fd = open(".", 0);
   n = 0;
-  while(read(fd, &de, sizeof(de)) > 0){
-    if(de.inum == 0)
-      continue;
-    if(de.name[0] == 'C' && de.name[2] == '\0'){
-      i = de.name[1] - '0';
+  while(read(fd, blk, BSIZE) == BSIZE){
+    for(off = 0; off < BSIZE; off += de->reclen){
+      de = (struct dirent*)(blk + off);
+      if(de->inum == 0 || de->namelen != 2 || de->name[0] != 'C')
+        continue;
+      i = de->name[1] - '0';
       if(i < 0 || i >= sizeof(fa)){
-        printf("%s: concreate weird file %s\n", s, de.name);
+        printf("%s: concreate weird file C%c\n", s, de->name[1]);
         exit(1);
       }
       if(fa[i]){
-        printf("%s: concreate duplicate file %s\n", s, de.name);
+        printf("%s: concreate duplicate file C%c\n", s, de->name[1]);
         exit(1);
       }
       fa[i] = 1;
@@ -1724,6 +1726,61 @@ bigwrite(char *s)
   }
 }
 
+// several processes write large files at once, so that the open
+// transaction, the one being committed and the committed blocks
+// not yet written home all hold buffers in the cache together.
+void
+bigwriters(char *s)
+{
+  enum { NCHILD = 4, N = 15 };
+  char name[8];
+  int c, fd, i, pid, xst;
+
+  for(c = 0; c < NCHILD; c++){
+    name[0] = 'b';
+    name[1] = 'w';
+    name[2] = '0' + c;
+    name[3] = '\0';
+    unlink(name);
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      fd = open(name, O_CREATE | O_RDWR);
+      if(fd < 0){
+        printf("%s: cannot create %s\n", s, name);
+        exit(1);
+      }
+      for(i = 0; i < N; i++){
+        memset(buf, 'a' + c + i, BUFSZ);
+        if(write(fd, buf, BUFSZ) != BUFSZ){
+          printf("%s: write %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      close(fd);
+      fd = open(name, O_RDONLY);
+      for(i = 0; i < N; i++){
+        if(read(fd, buf, BUFSZ) != BUFSZ ||
+           buf[0] != 'a' + c + i || buf[BUFSZ-1] != 'a' + c + i){
+          printf("%s: %s wrong data\n", s, name);
+          exit(1);
+        }
+      }
+      close(fd);
+      unlink(name);
+      exit(0);
+    }
+  }
+  for(c = 0; c < NCHILD; c++){
+    wait(&xst);
+    if(xst != 0)
+      exit(xst);
+  }
+}
+
 
 void
 bigfile(char *s)
@@ -1778,50 +1835,1112 @@ bigfile(char *s)
   unlink("bigfile.dat");
 }
 
+// fsync must succeed on open files, fail on bad fds, commit
+// what was written before it returns, and leave the data readable.
 void
-fourteen(char *s)
+fsynctest(char *s)
 {
-  int fd;
+  struct iostat s0, s1;
+  int fd, i;
+
+  if(fsync(-1) >= 0 || fsync(NOFILE) >= 0){
+    printf("%s: fsync of a bad fd succeeded\n", s);
+    exit(1);
+  }
+  unlink("fsync.dat");
+  fd = open("fsync.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create fsync.dat\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++){
+    memset(buf, 'a'+i, BSIZE);
+    iostat(&s0);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write fsync.dat failed\n", s);
+      exit(1);
+    }
+    if(fsync(fd) != 0){
+      printf("%s: fsync failed\n", s);
+      exit(1);
+    }
+    // the write's transaction must have committed, and
+    // nothing since has been logged.
+    iostat(&s1);
+    if(s1.ncommit == s0.ncommit || s1.ntxblocks != 0){
+      printf("%s: %d commits by fsync, %d blocks left open\n", s,
+             (int)(s1.ncommit - s0.ncommit), (int)s1.ntxblocks);
+      exit(1);
+    }
+  }
+  close(fd);
+  fd = open("fsync.dat", 0);
+  for(i = 0; i < 10; i++){
+    if(read(fd, buf, BSIZE) != BSIZE || buf[0] != 'a'+i || buf[BSIZE-1] != 'a'+i){
+      printf("%s: fsync.dat wrong data\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("fsync.dat");
+}
+
+// On a file system made with mkfs -o (rm fs.img; make
+// DATAMODE=-o qemu), file data must be written in place rather
+// than logged, and the blocks a deleted file frees must be kept
+// from the allocator until the free has committed.  On other
+// file systems there is nothing to check.
+void
+orderedtest(char *s)
+{
+  enum { N = 8 };
+  struct iostat s0, s1;
+  int fd, i, try, held;
+
+  iostat(&s0);
+  if((s0.fsflags & FS_ORDERED) == 0)
+    return;
+
+  unlink("ord.dat");
+  held = 0;
+  for(try = 0; try < 10 && !held; try++){
+    fd = open("ord.dat", O_CREATE | O_RDWR);
+    if(fd < 0){
+      printf("%s: cannot create ord.dat\n", s);
+      exit(1);
+    }
+    for(i = 0; i < N; i++){
+      memset(buf, 'a' + try + i, BSIZE);
+      if(write(fd, buf, BSIZE) != BSIZE){
+        printf("%s: write ord.dat failed\n", s);
+        exit(1);
+      }
+    }
+    if(fsync(fd) != 0){
+      printf("%s: fsync failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    iostat(&s1);
+    if(s1.ndatawrite < s0.ndatawrite + N){
+      printf("%s: file data was not written in place\n", s);
+      exit(1);
+    }
+    if(s1.nfreeheld != 0){
+      printf("%s: %d freed blocks held after a commit\n", s, (int)s1.nfreeheld);
+      exit(1);
+    }
+    fd = open("ord.dat", O_RDONLY);
+    for(i = 0; i < N; i++){
+      if(read(fd, buf, BSIZE) != BSIZE || buf[0] != 'a' + try + i || buf[BSIZE-1] != 'a' + try + i){
+        printf("%s: ord.dat has the wrong data\n", s);
+        exit(1);
+      }
+    }
+    close(fd);
+    // unless its transaction happens to commit right away,
+    // the file's blocks are now held.
+    unlink("ord.dat");
+    iostat(&s1);
+    held = s1.nfreeheld >= N;
+    s0 = s1;
+  }
+  if(!held){
+    printf("%s: freed blocks were not held until commit\n", s);
+    exit(1);
+  }
+}
 
-  // DIRSIZ is 14.
+// the allocators' free counts must go down by at least the
+// blocks and the inode a file uses, and come back when it is
+// deleted.
+void
+freecount(char *s)
+{
+  enum { N = 20 };
+  struct iostat s0, s1;
+  int fd, i;
 
-  if(mkdir("12345678901234") != 0){
-    printf("%s: mkdir 12345678901234 failed\n", s);
+  unlink("freecount.dat");
+  iostat(&s0);
+  fd = open("freecount.dat", O_CREATE | O_WRONLY);
+  if(fd < 0){
+    printf("%s: cannot create freecount.dat\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write freecount.dat failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  iostat(&s1);
+  if(s1.nifree + 1 != s0.nifree){
+    printf("%s: %d inodes free before, %d after\n", s, (int)s0.nifree, (int)s1.nifree);
+    exit(1);
+  }
+  if(s1.nfree + N > s0.nfree || s1.nalloc < s0.nalloc + N){
+    printf("%s: %d blocks free before, %d after\n", s, (int)s0.nfree, (int)s1.nfree);
     exit(1);
   }
-  if(mkdir("12345678901234/123456789012345") != 0){
-    printf("%s: mkdir 12345678901234/123456789012345 failed\n", s);
+  unlink("freecount.dat");
+  iostat(&s1);
+  if(s1.nfree != s0.nfree || s1.nifree != s0.nifree){
+    printf("%s: %d blocks free before, %d after unlink\n", s, (int)s0.nfree, (int)s1.nfree);
     exit(1);
   }
-  fd = open("123456789012345/123456789012345/123456789012345", O_CREATE);
+
+  // a closed small file keeps no preallocated blocks past its end.
+  fd = open("freecount.dat", O_CREATE | O_WRONLY);
   if(fd < 0){
-    printf("%s: create 123456789012345/123456789012345/123456789012345 failed\n", s);
+    printf("%s: cannot create freecount.dat\n", s);
     exit(1);
   }
+  for(i = 0; i < 4; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write freecount.dat failed\n", s);
+      exit(1);
+    }
+  }
   close(fd);
-  fd = open("12345678901234/12345678901234/12345678901234", 0);
+  iostat(&s1);
+  if(s1.nfree + 4 != s0.nfree){
+    printf("%s: a 4-block file holds %d blocks\n", s, (int)(s0.nfree - s1.nfree));
+    exit(1);
+  }
+  unlink("freecount.dat");
+}
+
+// fallocate must allocate a file's blocks without changing its
+// size, and writes that extend the file must then use them.
+void
+fallocatetest(char *s)
+{
+  enum { N = 20 };
+  struct iostat s0, s1, s2;
+  struct stat st;
+  int fd, i;
+
+  if(fallocate(-1, BSIZE) >= 0){
+    printf("%s: fallocate of a bad fd succeeded\n", s);
+    exit(1);
+  }
+  unlink("falloc.dat");
+  fd = open("falloc.dat", O_CREATE | O_RDWR);
   if(fd < 0){
-    printf("%s: open 12345678901234/12345678901234/12345678901234 failed\n", s);
+    printf("%s: cannot create falloc.dat\n", s);
+    exit(1);
+  }
+  iostat(&s0);
+  if(fallocate(fd, N*BSIZE) != 0){
+    printf("%s: fallocate failed\n", s);
+    exit(1);
+  }
+  iostat(&s1);
+  if(fstat(fd, &st) < 0 || st.size != 0){
+    printf("%s: fallocate changed the size\n", s);
+    exit(1);
+  }
+  if(s1.nalloc < s0.nalloc + N || s1.nfree + N > s0.nfree){
+    printf("%s: fallocate allocated %d blocks\n", s, (int)(s1.nalloc - s0.nalloc));
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, 'a'+i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write falloc.dat failed\n", s);
+      exit(1);
+    }
+  }
+  iostat(&s2);
+  if(s2.nalloc != s1.nalloc){
+    printf("%s: writes allocated %d more blocks\n", s, (int)(s2.nalloc - s1.nalloc));
+    exit(1);
+  }
+  close(fd);
+  iostat(&s1);
+  if(s1.nfree != s2.nfree){
+    printf("%s: close gave back %d fallocated blocks\n", s, (int)(s1.nfree - s2.nfree));
+    exit(1);
+  }
+  fd = open("falloc.dat", 0);
+  for(i = 0; i < N; i++){
+    if(read(fd, buf, BSIZE) != BSIZE || buf[0] != 'a'+i || buf[BSIZE-1] != 'a'+i){
+      printf("%s: falloc.dat wrong data\n", s);
+      exit(1);
+    }
+  }
+  if(read(fd, buf, 1) != 0){
+    printf("%s: read past the end of falloc.dat\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("falloc.dat");
+  iostat(&s1);
+  if(s1.nfree != s0.nfree){
+    printf("%s: %d blocks free before, %d after unlink\n", s, (int)s0.nfree, (int)s1.nfree);
+    exit(1);
+  }
+}
+
+// Count the entries in directory path by reading it a block
+// of records at a time, the way ls does.
+int
+countdir(char *s, char *path)
+{
+  char blk[BSIZE];
+  struct dirent *de;
+  uint off;
+  int fd, n;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    printf("%s: cannot open %s\n", s, path);
     exit(1);
   }
+  n = 0;
+  while(read(fd, blk, BSIZE) == BSIZE){
+    for(off = 0; off < BSIZE; off += de->reclen){
+      de = (struct dirent*)(blk + off);
+      if(de->reclen == 0){
+        printf("%s: %s has a record of length 0\n", s, path);
+        exit(1);
+      }
+      if(de->inum != 0)
+        n++;
+    }
+  }
   close(fd);
+  return n;
+}
+
+// a directory big enough to be indexed must still find every
+// name after deletions, and must still read as plain dirents.
+void
+dirindex(char *s)
+{
+  enum { N = 300 };
+  char name[16];
+  int i, fd;
 
-  if(mkdir("12345678901234/12345678901234") == 0){
-    printf("%s: mkdir 12345678901234/12345678901234 succeeded!\n", s);
+  unlink("dx/f");
+  for(i = 0; i < N; i++){
+    name[0] = 'd'; name[1] = 'x'; name[2] = '/';
+    name[3] = 'a' + i / 26 % 26; name[4] = 'a' + i % 26; name[5] = 0;
+    unlink(name);
+  }
+  unlink("dx");
+  if(mkdir("dx") != 0 || (fd = open("dx/f", O_CREATE | O_RDWR)) < 0){
+    printf("%s: cannot make dx/f\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < N; i++){
+    name[3] = 'a' + i / 26 % 26; name[4] = 'a' + i % 26;
+    if(link("dx/f", name) != 0){
+      printf("%s: link %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(countdir(s, "dx") != N + 3){
+    printf("%s: dx has %d entries, not %d\n", s, countdir(s, "dx"), N + 3);
+    exit(1);
+  }
+  for(i = 0; i < N; i += 2){
+    name[3] = 'a' + i / 26 % 26; name[4] = 'a' + i % 26;
+    if(unlink(name) != 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++){
+    name[3] = 'a' + i / 26 % 26; name[4] = 'a' + i % 26;
+    fd = open(name, O_RDONLY);
+    if((fd >= 0) != (i % 2 == 1)){
+      printf("%s: open %s gave %d\n", s, name, fd);
+      exit(1);
+    }
+    if(fd >= 0)
+      close(fd);
+  }
+  if((fd = open("dx/..", O_RDONLY)) < 0 || countdir(s, "dx") != N/2 + 3){
+    printf("%s: dx wrong after unlinks\n", s);
     exit(1);
   }
-  if(mkdir("123456789012345/12345678901234") == 0){
-    printf("%s: mkdir 12345678901234/123456789012345 succeeded!\n", s);
+  close(fd);
+  for(i = 1; i < N; i += 2){
+    name[3] = 'a' + i / 26 % 26; name[4] = 'a' + i % 26;
+    unlink(name);
+  }
+  unlink("dx/f");
+  if(unlink("dx") != 0){
+    printf("%s: unlink dx failed\n", s);
     exit(1);
   }
+}
 
-  // clean up
-  unlink("123456789012345/12345678901234");
-  unlink("12345678901234/12345678901234");
-  unlink("12345678901234/12345678901234/12345678901234");
-  unlink("123456789012345/123456789012345/123456789012345");
-  unlink("12345678901234/123456789012345");
-  unlink("12345678901234");
+// lookups answered by the directory entry cache must follow
+// creates and unlinks, including "no such file" answers, and
+// must not outlive a removed directory.
+void
+dcachetest(char *s)
+{
+  int fd, i;
+
+  unlink("dcd/x");
+  unlink("dcd");
+  unlink("dcf");
+  for(i = 0; i < 2; i++){
+    if(open("dcf", O_RDONLY) >= 0){
+      printf("%s: opened dcf before creating it\n", s);
+      exit(1);
+    }
+  }
+  if((fd = open("dcf", O_CREATE | O_RDWR)) < 0){
+    printf("%s: create dcf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("dcf", O_RDONLY)) < 0){
+    printf("%s: cannot open dcf after creating it\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("dcf");
+  if(open("dcf", O_RDONLY) >= 0){
+    printf("%s: opened dcf after unlink\n", s);
+    exit(1);
+  }
+
+  // a new directory may get the old one's inode number.
+  for(i = 0; i < 2; i++){
+    if(mkdir("dcd") != 0){
+      printf("%s: mkdir dcd failed\n", s);
+      exit(1);
+    }
+    if(open("dcd/x", O_RDONLY) >= 0){
+      printf("%s: dcd/x exists in a new directory\n", s);
+      exit(1);
+    }
+    if((fd = open("dcd/x", O_CREATE | O_RDWR)) < 0){
+      printf("%s: create dcd/x failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(chdir("dcd/..") != 0){
+      printf("%s: chdir dcd/.. failed\n", s);
+      exit(1);
+    }
+    if(unlink("dcd/x") != 0 || unlink("dcd") != 0){
+      printf("%s: unlink dcd failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// the in-memory inode table must grow when more inodes are in
+// use than it started with, rather than panic.
+void
+itablegrow(char *s)
+{
+  enum { NCHILD = 7, NOPEN = 10 };
+  int i, j, ready[2], done[2];
+  char name[8], c;
+  struct iostat st;
+
+  if(pipe(ready) < 0 || pipe(done) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  name[0] = 'i';
+  name[1] = 't';
+  name[4] = 0;
+  for(i = 0; i < NCHILD; i++){
+    if(fork() == 0){
+      close(done[1]);
+      for(j = 0; j < NOPEN; j++){
+        name[2] = '0' + i;
+        name[3] = 'a' + j;
+        if(open(name, O_CREATE | O_RDWR) < 0){
+          printf("%s: create %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      read(done[0], &c, 1);  // returns when the parent closes done[1]
+      exit(0);
+    }
+  }
+  close(done[0]);
+  for(i = 0; i < NCHILD; i++)
+    read(ready[0], &c, 1);
+  iostat(&st);
+  close(done[1]);
+  for(i = 0; i < NCHILD; i++)
+    wait(0);
+  close(ready[0]);
+  close(ready[1]);
+  for(i = 0; i < NCHILD; i++){
+    for(j = 0; j < NOPEN; j++){
+      name[2] = '0' + i;
+      name[3] = 'a' + j;
+      unlink(name);
+    }
+  }
+  if(st.ninode < NCHILD * NOPEN){
+    printf("%s: only %d inodes in the table\n", s, (int)st.ninode);
+    exit(1);
+  }
+}
+
+// sequential reads with readahead on and off must see
+// the same data, including after the file is re-read.
+void
+readahead(char *s)
+{
+  enum { N = 64 };
+  int fd, i, j, w, old;
+  int windows[] = { 0, 1, 4, 100 };
+
+  unlink("ra.dat");
+  fd = open("ra.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create ra.dat\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write ra.dat failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  old = setra(0);
+  for(w = 0; w < sizeof(windows)/sizeof(windows[0]); w++){
+    setra(windows[w]);
+    fd = open("ra.dat", 0);
+    if(fd < 0){
+      printf("%s: cannot open ra.dat\n", s);
+      exit(1);
+    }
+    for(i = 0; i < 2*N; i++){
+      if(read(fd, buf, BSIZE/2) != BSIZE/2){
+        printf("%s: short read ra.dat\n", s);
+        exit(1);
+      }
+      for(j = 0; j < BSIZE/2; j++){
+        if(buf[j] != i/2){
+          printf("%s: ra.dat wrong data, window %d\n", s, windows[w]);
+          exit(1);
+        }
+      }
+    }
+    if(read(fd, buf, 1) != 0){
+      printf("%s: read past end of ra.dat\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  setra(old);
+  unlink("ra.dat");
+}
+
+// a small file must read back the same while its data is in its
+// inode and after the data has moved out to a block, and once
+// truncated must fit in its inode again.  On a file system
+// without FS_INLINE only the contents are checked.
+void
+inlinetest(char *s)
+{
+  struct iostat s0, s1, s2;
+  char b[NINLINE+1];
+  int fd, i, inl;
+
+  for(i = 0; i < NINLINE+1; i++)
+    b[i] = 'a' + i % 26;
+  unlink("inl.dat");
+  fd = open("inl.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create inl.dat\n", s);
+    exit(1);
+  }
+  iostat(&s0);
+  if(write(fd, b, 10) != 10 || write(fd, b+10, NINLINE-10) != NINLINE-10){
+    printf("%s: write inl.dat failed\n", s);
+    exit(1);
+  }
+  iostat(&s1);
+  inl = s1.nfree == s0.nfree;
+  if(write(fd, b+NINLINE, 1) != 1 || write(fd, buf, 2*BSIZE) != 2*BSIZE){
+    printf("%s: write past %d bytes failed\n", s, NINLINE);
+    exit(1);
+  }
+  iostat(&s2);
+  if(inl && s2.nunline != s1.nunline + 1){
+    printf("%s: inl.dat was not moved out of its inode\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("inl.dat", O_RDONLY);
+  if(read(fd, buf, NINLINE+1) != NINLINE+1 || memcmp(buf, b, NINLINE+1) != 0){
+    printf("%s: inl.dat wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("inl.dat", O_RDWR | O_TRUNC);
+  if(write(fd, "hello", 5) != 5){
+    printf("%s: write after truncate failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  iostat(&s2);
+  if(inl && s2.nfree != s0.nfree){
+    printf("%s: truncated inl.dat still has %d blocks\n", s, (int)(s0.nfree - s2.nfree));
+    exit(1);
+  }
+  fd = open("inl.dat", O_RDONLY);
+  if(read(fd, buf, BSIZE) != 5 || memcmp(buf, "hello", 5) != 0){
+    printf("%s: inl.dat wrong data after truncate\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("inl.dat");
+}
+
+// with FS_EXTENTS, mkfs maps each file with the extents in its
+// inode; a file whose blocks are interleaved with another's gets
+// more extents than the inode holds, and grows a tree with one
+// node block, which truncating it frees.  On other file systems
+// there is nothing to check.
+void
+extenttest(char *s)
+{
+  enum { N = 64 };
+  char *files[] = { "/README", "/usertests" };
+  struct iostat s0, s1;
+  struct stat st;
+  int fa, fb, i, try, grown;
+
+  iostat(&s0);
+  if((s0.fsflags & FS_EXTENTS) == 0)
+    return;
+
+  for(i = 0; i < sizeof(files)/sizeof(files[0]); i++){
+    if(stat(files[i], &st) < 0){
+      printf("%s: cannot stat %s\n", s, files[i]);
+      exit(1);
+    }
+    if(st.blocks != (st.size + BSIZE - 1) / BSIZE){
+      printf("%s: %s holds %d blocks for %d bytes\n", s, files[i], st.blocks, (int)st.size);
+      exit(1);
+    }
+  }
+
+  // which blocks the two files get depends on where their inodes
+  // are; try again with new ones if they did not interleave.
+  grown = 0;
+  for(try = 0; try < 10 && !grown; try++){
+    unlink("ext.a");
+    unlink("ext.b");
+    fa = open("ext.a", O_CREATE | O_WRONLY);
+    fb = open("ext.b", O_CREATE | O_WRONLY);
+    if(fa < 0 || fb < 0){
+      printf("%s: cannot create ext.a and ext.b\n", s);
+      exit(1);
+    }
+    for(i = 0; i < N; i++){
+      if(write(fa, buf, BSIZE) != BSIZE || write(fb, buf, BSIZE) != BSIZE){
+        printf("%s: write ext.a or ext.b failed\n", s);
+        exit(1);
+      }
+    }
+    close(fa);
+    close(fb);
+    if(stat("ext.a", &st) < 0){
+      printf("%s: cannot stat ext.a\n", s);
+      exit(1);
+    }
+    if(st.blocks != N && st.blocks != N + 1){
+      printf("%s: ext.a holds %d blocks for %d\n", s, st.blocks, N);
+      exit(1);
+    }
+    grown = st.blocks == N + 1;
+  }
+  if(!grown){
+    printf("%s: ext.a never needed an extent node\n", s);
+    exit(1);
+  }
+
+  unlink("ext.b");
+  fa = open("ext.a", O_WRONLY | O_TRUNC);
+  if(fa < 0 || fstat(fa, &st) < 0 || st.blocks != 0){
+    printf("%s: truncated ext.a still holds blocks\n", s);
+    exit(1);
+  }
+  close(fa);
+  unlink("ext.a");
+  iostat(&s1);
+  if(s1.nfree != s0.nfree){
+    printf("%s: %d blocks free before, %d after\n", s, (int)s0.nfree, (int)s1.nfree);
+    exit(1);
+  }
+}
+
+// getdents() must return every entry of a directory once, with
+// its inode's number, type and size, whatever the buffer size.
+void
+getdentstest(char *s)
+{
+  enum { N = 60 };
+  char name[8], seen[N], dbuf[512];
+  struct dent *d;
+  struct stat st;
+  int fd, i, n, off, k, bufsz, dots;
+
+  mkdir("gd");
+  for(i = 0; i < N; i++){
+    name[0] = 'g'; name[1] = 'd'; name[2] = '/';
+    name[3] = 'a' + i / 26; name[4] = 'a' + i % 26; name[5] = 0;
+    if((fd = open(name, O_CREATE | O_WRONLY)) < 0 || write(fd, buf, i) != i){
+      printf("%s: cannot write %s\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+  mkdir("gd/sub");
+  if(stat("gd/sub", &st) < 0){
+    printf("%s: cannot stat gd/sub\n", s);
+    exit(1);
+  }
+
+  // one entry per call, and many.
+  for(k = 0; k < 2; k++){
+    bufsz = k == 0 ? DENTREC(3) : sizeof(dbuf);
+    memset(seen, 0, sizeof(seen));
+    dots = 0;
+    fd = open("gd", O_RDONLY);
+    while((n = getdents(fd, (struct dent*)dbuf, bufsz)) > 0){
+      for(off = 0; off < n; off += d->reclen){
+        d = (struct dent*)(dbuf + off);
+        if(strcmp(d->name, ".") == 0 || strcmp(d->name, "..") == 0){
+          dots++;
+          if(d->type != T_DIR){
+            printf("%s: %s is not a directory\n", s, d->name);
+            exit(1);
+          }
+          continue;
+        }
+        if(strcmp(d->name, "sub") == 0){
+          if(d->type != T_DIR || d->ino != st.ino){
+            printf("%s: getdents got sub wrong\n", s);
+            exit(1);
+          }
+          continue;
+        }
+        i = (d->name[0] - 'a') * 26 + d->name[1] - 'a';
+        if(i < 0 || i >= N || seen[i] || d->type != T_FILE || d->size != i){
+          printf("%s: getdents got %s (type %d size %d) wrong\n", s, d->name, d->type, (int)d->size);
+          exit(1);
+        }
+        seen[i] = 1;
+      }
+    }
+    close(fd);
+    for(i = 0; i < N; i++){
+      if(!seen[i]){
+        printf("%s: getdents with %d bytes missed entry %d\n", s, bufsz, i);
+        exit(1);
+      }
+    }
+    if(n < 0 || dots != 2){
+      printf("%s: getdents with %d bytes failed\n", s, bufsz);
+      exit(1);
+    }
+  }
+
+  fd = open("gd", O_RDONLY);
+  if(getdents(fd, (struct dent*)dbuf, DENTREC(0) - 1) != -1){
+    printf("%s: getdents into a buffer too small succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("gd/aa", O_RDONLY);
+  if(getdents(fd, (struct dent*)dbuf, sizeof(dbuf)) != -1){
+    printf("%s: getdents of a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < N; i++){
+    name[3] = 'a' + i / 26; name[4] = 'a' + i % 26;
+    unlink(name);
+  }
+  unlink("gd/sub");
+  unlink("gd");
+}
+
+// pread() and pwrite() must use their offset and leave the
+// file's alone, lseek() must move it, and readv() and writev()
+// must fill and drain their buffers in order, on files and on
+// pipes.
+void
+rwvtest(char *s)
+{
+  char hdr[8], tail[4], b[16];
+  struct iovec iov[3];
+  int fd, i, n, fds[2];
+
+  unlink("rwv.dat");
+  fd = open("rwv.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create rwv.dat\n", s);
+    exit(1);
+  }
+  // header, payload spanning blocks, and an empty buffer.
+  memset(hdr, 'h', sizeof(hdr));
+  for(i = 0; i < 3*BSIZE; i++)
+    buf[i] = 'a' + i % 26;
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = 3*BSIZE;
+  iov[2].iov_base = 0;
+  iov[2].iov_len = 0;
+  if(writev(fd, iov, 3) != sizeof(hdr) + 3*BSIZE){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_CUR) != sizeof(hdr) + 3*BSIZE){
+    printf("%s: writev left the wrong offset\n", s);
+    exit(1);
+  }
+
+  // overwrite the header in place.
+  if(pwrite(fd, "HH", 2, 3) != 2 || lseek(fd, 0, SEEK_CUR) != sizeof(hdr) + 3*BSIZE){
+    printf("%s: pwrite failed or moved the offset\n", s);
+    exit(1);
+  }
+  if(pread(fd, b, 4, 2) != 4 || memcmp(b, "hHHh", 4) != 0){
+    printf("%s: pread read the wrong bytes\n", s);
+    exit(1);
+  }
+  if(pread(fd, b, 4, sizeof(hdr) + BSIZE) != 4 || b[0] != 'a' + BSIZE % 26){
+    printf("%s: pread across blocks read the wrong bytes\n", s);
+    exit(1);
+  }
+
+  if(lseek(fd, -4, SEEK_END) != sizeof(hdr) + 3*BSIZE - 4 ||
+     read(fd, tail, 4) != 4 || tail[3] != 'a' + (3*BSIZE - 1) % 26){
+    printf("%s: lseek from the end failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 1, SEEK_END) != -1 || lseek(fd, -1, SEEK_SET) != -1 || lseek(fd, 0, 7) != -1 ||
+     lseek(fd, 0x7fffffff, SEEK_END) != -1 || lseek(fd, 0x7fffffff, SEEK_CUR) != -1){
+    printf("%s: bad lseek succeeded\n", s);
+    exit(1);
+  }
+
+  // read it back into three buffers.
+  if(lseek(fd, 0, SEEK_SET) != 0){
+    printf("%s: lseek to 0 failed\n", s);
+    exit(1);
+  }
+  memset(buf, 0, 3*BSIZE);
+  iov[0].iov_base = b;
+  iov[0].iov_len = 5;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = 3*BSIZE - 1;
+  iov[2].iov_base = tail;
+  iov[2].iov_len = sizeof(tail);
+  n = readv(fd, iov, 3);
+  if(n != sizeof(hdr) + 3*BSIZE || memcmp(b, "hhhHH", 5) != 0 ||
+     memcmp(buf, "hhh", 3) != 0 || buf[3] != 'a' ||
+     tail[0] != 'a' + (3*BSIZE - 4) % 26){
+    printf("%s: readv got %d bytes, or the wrong ones\n", s, n);
+    exit(1);
+  }
+  close(fd);
+  unlink("rwv.dat");
+
+  // pipes take vectors too, but have no offsets.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "ab";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = "cde";
+  iov[1].iov_len = 3;
+  if(writev(fds[1], iov, 2) != 5 || read(fds[0], b, sizeof(b)) != 5 || memcmp(b, "abcde", 5) != 0){
+    printf("%s: writev to a pipe failed\n", s);
+    exit(1);
+  }
+  if(pread(fds[0], b, 1, 0) != -1 || lseek(fds[0], 0, SEEK_SET) != -1){
+    printf("%s: pread or lseek of a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// sendfile() must copy a file into a pipe and into another
+// file, splice() must drain a pipe into a file, and both must
+// leave the offsets after what they moved.
+void
+splicetest(char *s)
+{
+  enum { N = 3*BSIZE + 100 };
+  char b[64];
+  int fd, fd2, i, n, tot, fds[2], pid, xst;
+
+  unlink("splice.in");
+  unlink("splice.out");
+  fd = open("splice.in", O_CREATE | O_RDWR);
+  for(i = 0; i < N; i++)
+    buf[i] = 'a' + i % 23;
+  if(fd < 0 || write(fd, buf, N) != N){
+    printf("%s: cannot write splice.in\n", s);
+    exit(1);
+  }
+
+  // file to pipe, from a child so that the pipe can fill up.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    lseek(fd, 10, SEEK_SET);
+    if(sendfile(fds[1], fd, N) != N - 10 || sendfile(fds[1], fd, N) != 0)
+      exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  tot = 0;
+  while((n = read(fds[0], b, sizeof(b))) > 0){
+    for(i = 0; i < n; i++){
+      if(b[i] != 'a' + (10 + tot + i) % 23){
+        printf("%s: sendfile to a pipe sent the wrong bytes\n", s);
+        exit(1);
+      }
+    }
+    tot += n;
+  }
+  close(fds[0]);
+  wait(&xst);
+  if(xst != 0 || tot != N - 10){
+    printf("%s: sendfile to a pipe sent %d bytes\n", s, tot);
+    exit(1);
+  }
+
+  // file to file.
+  fd2 = open("splice.out", O_CREATE | O_RDWR);
+  if(fd2 < 0 || lseek(fd, 0, SEEK_SET) != 0 || sendfile(fd2, fd, N) != N ||
+     lseek(fd2, 0, SEEK_CUR) != N){
+    printf("%s: sendfile to a file failed\n", s);
+    exit(1);
+  }
+  memset(buf, 0, N);
+  if(pread(fd2, buf, N, 0) != N || buf[0] != 'a' || buf[N-1] != 'a' + (N-1) % 23){
+    printf("%s: sendfile to a file wrote the wrong bytes\n", s);
+    exit(1);
+  }
+
+  // pipe to file.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(i = 0; i < N; i++)
+      buf[i] = 'A' + i % 19;
+    if(write(fds[1], buf, N) != N)
+      exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  lseek(fd2, 0, SEEK_SET);
+  tot = 0;
+  while((n = splice(fds[0], fd2, N)) > 0)
+    tot += n;
+  close(fds[0]);
+  wait(&xst);
+  if(n < 0 || xst != 0 || tot != N){
+    printf("%s: splice from a pipe moved %d bytes\n", s, tot);
+    exit(1);
+  }
+  memset(buf, 0, N);
+  if(pread(fd2, buf, N, 0) != N || buf[0] != 'A' || buf[N-1] != 'A' + (N-1) % 19){
+    printf("%s: splice from a pipe wrote the wrong bytes\n", s);
+    exit(1);
+  }
+
+  // splice() needs a pipe; sendfile() a file to read.
+  if(splice(fd, fd2, 1) != -1 || sendfile(fd2, 0, 1) != -1){
+    printf("%s: splice between files or sendfile from a device succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+  unlink("splice.in");
+  unlink("splice.out");
+}
+
+// F_SETPIPE_SZ must round pipe sizes up to a power of two
+// pages, keep the data in the pipe, and refuse sizes too big
+// or too small for it; and writers held back until half a
+// pipe is free must still get all their data through.
+void
+pipesztest(char *s)
+{
+  enum { N = 3000, M = 10000, BIG = 100000 };
+  int fds[2], i, n, tot, pid, xst, sz;
+  char b[100];
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if((sz = fcntl(fds[0], F_GETPIPE_SZ, 0)) < 4096){
+    printf("%s: pipe of %d bytes\n", s, sz);
+    exit(1);
+  }
+  for(i = 0; i < N + M; i++)
+    buf[i] = 'a' + i % 13;
+  if(write(fds[1], buf, N) != N || read(fds[0], b, sizeof(b)) != sizeof(b)){
+    printf("%s: pipe write or read failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, M) != 16384 || fcntl(fds[0], F_GETPIPE_SZ, 0) != 16384){
+    printf("%s: cannot grow the pipe\n", s);
+    exit(1);
+  }
+  // fits now without a reader.
+  if(write(fds[1], buf + N, M) != M){
+    printf("%s: write to the grown pipe failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) != -1){
+    printf("%s: shrank a pipe below its data\n", s);
+    exit(1);
+  }
+  for(tot = sizeof(b); tot < N + M; tot += n){
+    n = read(fds[0], b, sizeof(b));
+    if(n <= 0 || memcmp(b, buf + tot, n) != 0){
+      printf("%s: resizing lost pipe data at %d\n", s, tot);
+      exit(1);
+    }
+  }
+  if(fcntl(fds[0], F_SETPIPE_SZ, 1) != 4096 || fcntl(fds[0], F_SETPIPE_SZ, 1 << 30) != -1 ||
+     fcntl(fds[0], 99, 0) != -1 || fcntl(0, F_GETPIPE_SZ, 0) != -1){
+    printf("%s: bad fcntl did the wrong thing\n", s);
+    exit(1);
+  }
+
+  // a big write into the small pipe, read out in small pieces.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(tot = 0; tot < BIG; tot += n){
+      n = BIG - tot < BUFSZ ? BIG - tot : BUFSZ;
+      memset(buf, 'x', n);
+      if(write(fds[1], buf, n) != n)
+        exit(1);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  tot = 0;
+  while((n = read(fds[0], b, sizeof(b))) > 0)
+    tot += n;
+  close(fds[0]);
+  wait(&xst);
+  if(xst != 0 || tot != BIG){
+    printf("%s: read %d bytes of %d\n", s, tot, BIG);
+    exit(1);
+  }
+}
+
+// names may be DIRSIZ bytes long; longer path elements are
+// cut to DIRSIZ bytes.
+void
+longname(char *s)
+{
+  char a[DIRSIZ+1], b[DIRSIZ+2], blk[BSIZE];
+  struct dirent *de;
+  uint off;
+  int fd, found;
+
+  memset(a, 'x', DIRSIZ);
+  a[DIRSIZ] = 0;
+  memset(b, 'x', DIRSIZ+1);
+  b[DIRSIZ+1] = 0;
+
+  if(mkdir(a) != 0){
+    printf("%s: mkdir of a %d-byte name failed\n", s, DIRSIZ);
+    exit(1);
+  }
+  if(chdir(a) != 0){
+    printf("%s: chdir to a %d-byte name failed\n", s, DIRSIZ);
+    exit(1);
+  }
+  fd = open(b, O_CREATE);
+  if(fd < 0){
+    printf("%s: create of a %d-byte name failed\n", s, DIRSIZ+1);
+    exit(1);
+  }
+  close(fd);
+  fd = open(a, 0);
+  if(fd < 0){
+    printf("%s: %d-byte name not cut to %d bytes\n", s, DIRSIZ+1, DIRSIZ);
+    exit(1);
+  }
+  close(fd);
+  if(mkdir(a) == 0){
+    printf("%s: mkdir of an existing %d-byte name succeeded!\n", s, DIRSIZ);
+    exit(1);
+  }
+
+  // the whole name is in the directory.
+  found = 0;
+  fd = open(".", 0);
+  while(read(fd, blk, BSIZE) == BSIZE){
+    for(off = 0; off < BSIZE; off += de->reclen){
+      de = (struct dirent*)(blk + off);
+      if(de->inum != 0 && de->namelen == DIRSIZ && memcmp(de->name, a, DIRSIZ) == 0)
+        found++;
+    }
+  }
+  close(fd);
+  if(found != 1){
+    printf("%s: %d-byte name found %d times\n", s, DIRSIZ, found);
+    exit(1);
+  }
+
+  // clean up
+  if(unlink(a) != 0 || chdir("..") != 0 || unlink(a) != 0){
+    printf("%s: clean up of %d-byte names failed\n", s, DIRSIZ);
+    exit(1);
+  }
 }
 
 void
@@ -2612,8 +3731,23 @@ struct test {
   {linkunlink, "linkunlink"},
   {subdir, "subdir"},
   {bigwrite, "bigwrite"},
+  {bigwriters, "bigwriters"},
   {bigfile, "bigfile"},
-  {fourteen, "fourteen"},
+  {readahead, "readahead"},
+  {fsynctest, "fsynctest"},
+  {orderedtest, "orderedtest"},
+  {freecount, "freecount"},
+  {fallocatetest, "fallocatetest"},
+  {dirindex, "dirindex"},
+  {dcachetest, "dcachetest"},
+  {itablegrow, "itablegrow"},
+  {inlinetest, "inlinetest"},
+  {extenttest, "extenttest"},
+  {getdentstest, "getdentstest"},
+  {rwvtest, "rwvtest"},
+  {splicetest, "splicetest"},
+  {pipesztest, "pipesztest"},
+  {longname, "longname"},
   {rmdot, "rmdot"},
   {dirfile, "dirfile"},
   {iref, "iref"},
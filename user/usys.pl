@@ -36,3 +36,16 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("iostat");
+entry("setra");
+entry("fsync");
+entry("fallocate");
+entry("getdents");
+entry("pread");
+entry("pwrite");
+entry("lseek");
+entry("readv");
+entry("writev");
+entry("sendfile");
+entry("splice");
+entry("fcntl");